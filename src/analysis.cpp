@@ -0,0 +1,355 @@
+/*
+  Stockfish, a UCI chess playing engine derived from Glaurung 2.1
+  Copyright (C) 2004-2024 The Stockfish developers (see AUTHORS file)
+
+  Stockfish is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Stockfish is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include <cctype>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "analysis.h"
+#include "misc.h"
+#include "movegen.h"
+#include "position.h"
+#include "san.h"
+#include "search.h"
+#include "thread.h"
+#include "uci.h"
+
+namespace Stockfish::Analysis {
+
+namespace {
+
+  const char* StartFEN = "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1";
+
+  // A played move is classified by how much it drops the expected score of the
+  // side to move compared to the best move, in per mille, see UCI::expected_score()
+  constexpr int Inaccuracy = 50, Mistake = 100, Blunder = 150;
+
+  const char* ErrorNames[] = { "ok", "inaccuracy", "mistake", "blunder" };
+
+  struct Game {
+    std::string fen = StartFEN;
+    bool chess960 = false;
+    std::vector<std::string> moves; // In UCI notation or in SAN
+  };
+
+  struct Analyzed {
+    Move best;
+    Value score; // For the side to move
+    Depth depth;
+  };
+
+
+  // read_position() reads a game given like to the 'position' command, that is
+  // "startpos" or "fen <fen>", followed by "moves" and the moves, if any.
+
+  Game read_position(std::istringstream& is, const std::string& first) {
+
+    Game game;
+    std::string token;
+
+    game.chess960 = Options["UCI_Chess960"];
+
+    if (first == "fen")
+    {
+        game.fen.clear();
+        while (is >> token && token != "moves")
+            game.fen += token + " ";
+    }
+    else
+        is >> token; // Consume the "moves" token, if any
+
+    while (is >> token)
+        game.moves.push_back(token);
+
+    return game;
+  }
+
+
+  // read_pgn() returns the main line of each game of a PGN file, starting from
+  // the position of its FEN tag, if any. Comments, variations, numeric annotation
+  // glyphs, move numbers and move suffixes like '+' or '!?' are skipped.
+
+  std::vector<Game> read_pgn(const std::string& name) {
+
+    std::ifstream in(name);
+    std::vector<Game> games;
+    Game game;
+    std::string line, token;
+    bool started = false, comment = false;
+    int variation = 0;
+
+    auto finish = [&]() {
+        if (started)
+            games.push_back(game);
+
+        game = Game();
+        game.chess960 = Options["UCI_Chess960"];
+        started = false;
+    };
+
+    auto add = [&](std::string tok) {
+
+        tok = tok.substr(tok.find_last_of('.') + 1); // "12." or "12..." glued to the move
+
+        if (tok.empty() || tok[0] == '$')
+            return;
+
+        if (tok == "1-0" || tok == "0-1" || tok == "1/2-1/2" || tok == "*")
+        {
+            started = true;
+            finish();
+            return;
+        }
+
+        while (!tok.empty() && std::strchr("+#!?", tok.back()))
+            tok.pop_back();
+
+        if (!tok.empty())
+            game.moves.push_back(tok), started = true;
+    };
+
+    finish(); // Nothing yet, just set up the first game
+
+    while (std::getline(in, line))
+    {
+        // Tags look like [FEN "8/8/4k3/8/8/4K3/4P3/8 w - - 0 1"]
+        if (!comment && !variation && !line.empty() && line[0] == '[')
+        {
+            if (started)
+                finish();
+
+            size_t q1 = line.find('"'), q2 = line.rfind('"');
+            std::string tag = line.substr(1, line.find_first_of(" \t") - 1);
+
+            if (q1 != std::string::npos && q2 > q1)
+            {
+                std::string value = line.substr(q1 + 1, q2 - q1 - 1);
+
+                if (tag == "FEN")
+                    game.fen = value;
+                else if (tag == "Variant")
+                    game.chess960 = value.find("960") != std::string::npos;
+            }
+            continue;
+        }
+
+        for (size_t i = 0; i <= line.size(); ++i)
+        {
+            char c = i < line.size() ? line[i] : ' ';
+
+            if (comment)
+                comment = c != '}';
+
+            else if (c == '{' || c == ';' || c == '(' || c == ')' || std::isspace(uint8_t(c)))
+            {
+                if (!variation)
+                    add(token);
+
+                token.clear();
+
+                if (c == ';') // Comment up to the end of the line
+                    break;
+
+                comment = c == '{';
+                variation += (c == '(') - (c == ')' && variation > 0);
+            }
+            else
+                token += c;
+        }
+    }
+
+    finish(); // The last game may have no result
+
+    return games;
+  }
+
+
+  // from_child() converts the score of the position after a move, for the side
+  // to move there, to the score of the move for the side that played it.
+
+  Value from_child(Value v) {
+
+    v = -v;
+    return v >= VALUE_MATE_IN_MAX_PLY  ? v - 1
+         : v <= VALUE_MATED_IN_MAX_PLY ? v + 1 : v;
+  }
+
+
+  // analyze() searches the positions of the game from the last one back to the
+  // first, so that each search finds in the hash table what the search of the
+  // next position learned about the continuation of the game, and then reports
+  // each played move against the best move. The positions are set up in 'pos'
+  // and 'states', which the search threads keep using, so they are those of
+  // the UCI loop and end at the last position of the game.
+
+  void analyze(Position& pos, StateListPtr& states, const Game& game, size_t index, const Search::LimitsType& base) {
+
+    std::vector<Move> moves;
+
+    states = StateListPtr(new std::deque<StateInfo>(1));
+    pos.set(game.fen, game.chess960, &states->back(), Threads.main());
+
+    for (std::string str : game.moves)
+    {
+        Move m = UCI::to_move(pos, str);
+
+        if (!m)
+            m = SAN::algebraic_to_move(pos, str);
+
+        if (!m || !MoveList<LEGAL>(pos).contains(m))
+        {
+            sync_cout << "info string Illegal move " << str << " in game " << index
+                      << ", analyzing up to it" << sync_endl;
+            break;
+        }
+
+        moves.push_back(m);
+        states->emplace_back();
+        pos.do_move(m, states->back());
+    }
+
+    std::vector<Analyzed> results(moves.size() + 1);
+    uint64_t nodes = 0;
+
+    // A new game, the positions of the game share the hash table and histories
+    Search::clear();
+    Threads.wait_for_idle();
+
+    TimePoint start = now();
+
+    for (size_t k = moves.size() + 1; k-- > 0; )
+    {
+        states = StateListPtr(new std::deque<StateInfo>(1));
+        pos.set(game.fen, game.chess960, &states->back(), Threads.main());
+
+        for (size_t i = 0; i < k; ++i)
+        {
+            states->emplace_back();
+            pos.do_move(moves[i], states->back());
+        }
+
+        if (!pos.has_legal_move())
+        {
+            results[k] = { Move::none(), pos.checkers() ? mated_in(0) : VALUE_DRAW, 0 };
+            continue;
+        }
+
+        Search::LimitsType limits = base;
+        limits.startTime = now();
+
+        Threads.start_thinking(pos, states, limits);
+        Threads.main()->wait_for_search_finished();
+        nodes += Threads.nodes_searched();
+
+        // The thread the search took its best move from, see MainThread::search()
+        Thread* th = int(Options["MultiPV"]) == 1 && !limits.depth ? Threads.get_best_thread() : Threads.main();
+        const Search::RootMove& rm = th->rootMoves[0];
+
+        results[k] = { rm.pv[0], rm.score != -VALUE_INFINITE ? rm.score : rm.previousScore, th->completedDepth };
+    }
+
+    TimePoint elapsed = now() - start + 1; // Ensure positivity to avoid a 'divide by zero'
+
+    // Report the played moves in the order of the game
+    states = StateListPtr(new std::deque<StateInfo>(1));
+    pos.set(game.fen, game.chess960, &states->back(), Threads.main());
+
+    int errors[COLOR_NB][4] = {}, drops[COLOR_NB] = {}, played[COLOR_NB] = {};
+
+    for (size_t i = 0; i < moves.size(); ++i)
+    {
+        const Color us = pos.side_to_move();
+        const Value best = results[i].score, value = from_child(results[i + 1].score);
+
+        int drop = moves[i] == results[i].best ? 0
+                  : std::max(0,   UCI::expected_score(best, pos.game_ply())
+                                - UCI::expected_score(value, pos.game_ply()));
+
+        int error = (drop >= Inaccuracy) + (drop >= Mistake) + (drop >= Blunder);
+
+        ++errors[us][error];
+        drops[us] += drop;
+        ++played[us];
+
+        sync_cout << "info string game " << index << " move " << 1 + pos.game_ply() / 2
+                  << (us == WHITE ? ". " : "... ") << SAN::to_san(pos, moves[i])
+                  << " score " << UCI::value(value)
+                  << " best " << SAN::to_san(pos, results[i].best) << " " << UCI::value(best)
+                  << " depth " << results[i].depth
+                  << " loss " << drop << " " << ErrorNames[error] << sync_endl;
+
+        states->emplace_back();
+        pos.do_move(moves[i], states->back());
+    }
+
+    for (Color c : { WHITE, BLACK })
+        sync_cout << "info string game " << index << (c == WHITE ? " white" : " black")
+                  << " moves " << played[c]
+                  << " average loss " << drops[c] / std::max(played[c], 1)
+                  << " inaccuracies " << errors[c][1]
+                  << " mistakes " << errors[c][2]
+                  << " blunders " << errors[c][3] << sync_endl;
+
+    sync_cout << "info string game " << index << " positions " << results.size()
+              << " nodes " << nodes
+              << " time " << elapsed
+              << " nps " << nodes * 1000 / elapsed << sync_endl;
+  }
+
+} // namespace
+
+
+// Analysis::run() is called by the 'analyze' command. The search limits come
+// first, then either 'pgn <file>' or a game given like to the 'position'
+// command. Without limits, each position is searched to depth 16. As with
+// 'bench', the position of the UCI loop is left at the last analyzed position.
+
+void run(Position& pos, std::istringstream& is, StateListPtr& states) {
+
+  Search::LimitsType limits;
+  std::vector<Game> games;
+  std::string token;
+
+  while (is >> token)
+      if (token == "depth")         is >> limits.depth;
+      else if (token == "nodes")    is >> limits.nodes;
+      else if (token == "movetime") is >> limits.movetime;
+      else if (token == "pgn")
+      {
+          std::string name;
+          std::getline(is >> std::ws, name);
+          games = read_pgn(name);
+
+          if (games.empty())
+              sync_cout << "info string No game found in " << name << sync_endl;
+      }
+      else if (token == "startpos" || token == "fen")
+          games.push_back(read_position(is, token));
+
+  if (!limits.depth && !limits.nodes && !limits.movetime)
+      limits.depth = 16;
+
+  for (size_t i = 0; i < games.size(); ++i)
+      analyze(pos, states, games[i], i + 1, limits);
+}
+
+} // namespace Stockfish::Analysis
@@ -0,0 +1,38 @@
+/*
+  Stockfish, a UCI chess playing engine derived from Glaurung 2.1
+  Copyright (C) 2004-2024 The Stockfish developers (see AUTHORS file)
+
+  Stockfish is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Stockfish is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef ANALYSIS_H_INCLUDED
+#define ANALYSIS_H_INCLUDED
+
+#include <sstream>
+
+#include "position.h"
+
+namespace Stockfish::Analysis {
+
+// run() analyzes the games given to the 'analyze' command, from the last
+// position of each game back to the first, keeping the hash table and the
+// histories between the positions, and reports the played moves. It sets up
+// the positions in those of the UCI loop, like 'bench'.
+
+void run(Position& pos, std::istringstream& is, StateListPtr& states);
+
+} // namespace Stockfish::Analysis
+
+#endif // #ifndef ANALYSIS_H_INCLUDED
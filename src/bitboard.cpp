@@ -18,6 +18,9 @@
 
 #include <algorithm>
 #include <bitset>
+#include <map>
+#include <memory>
+#include <mutex>
 
 #include "bitboard.h"
 #include "misc.h"
@@ -28,20 +31,16 @@ uint8_t PopCnt16[1 << 16];
 uint8_t SquareDistance[SQUARE_NB][SQUARE_NB];
 
 Bitboard SquareBB[SQUARE_NB];
-Bitboard LineBB[SQUARE_NB][SQUARE_NB];
-Bitboard BetweenBB[SQUARE_NB][SQUARE_NB];
-Bitboard PseudoAttacks[PIECE_TYPE_NB][SQUARE_NB];
-Bitboard PawnAttacks[COLOR_NB][SQUARE_NB];
 
-Magic RookMagics[SQUARE_NB];
-Magic BishopMagics[SQUARE_NB];
+AttackTables MainTables;
 
-namespace {
+#ifdef USE_NUMA
+thread_local const AttackTables* LocalTables = &MainTables;
+#endif
 
-  Bitboard RookTable[0x19000];  // To store rook attacks
-  Bitboard BishopTable[0x1480]; // To store bishop attacks
+namespace {
 
-  void init_magics(PieceType pt, Bitboard table[], Magic magics[]);
+  void init_magics(PieceType pt, SliderAttacks table[], Magic magics[]);
 
 }
 
@@ -89,36 +88,76 @@ void Bitboards::init() {
       for (Square s2 = SQ_A1; s2 <= SQ_H8; ++s2)
           SquareDistance[s1][s2] = std::max(distance<File>(s1, s2), distance<Rank>(s1, s2));
 
-  init_magics(ROOK, RookTable, RookMagics);
-  init_magics(BISHOP, BishopTable, BishopMagics);
+  AttackTables& t = MainTables;
+
+  init_magics(ROOK, t.RookTable, t.RookMagics);
+  init_magics(BISHOP, t.BishopTable, t.BishopMagics);
 
   for (Square s1 = SQ_A1; s1 <= SQ_H8; ++s1)
   {
-      PawnAttacks[WHITE][s1] = pawn_attacks_bb<WHITE>(square_bb(s1));
-      PawnAttacks[BLACK][s1] = pawn_attacks_bb<BLACK>(square_bb(s1));
+      t.PawnAttacks[WHITE][s1] = pawn_attacks_bb<WHITE>(square_bb(s1));
+      t.PawnAttacks[BLACK][s1] = pawn_attacks_bb<BLACK>(square_bb(s1));
 
       for (int step : {-9, -8, -7, -1, 1, 7, 8, 9} )
-         PseudoAttacks[KING][s1] |= safe_destination(s1, step);
+         t.PseudoAttacks[KING][s1] |= safe_destination(s1, step);
 
       for (int step : {-17, -15, -10, -6, 6, 10, 15, 17} )
-         PseudoAttacks[KNIGHT][s1] |= safe_destination(s1, step);
+         t.PseudoAttacks[KNIGHT][s1] |= safe_destination(s1, step);
 
-      PseudoAttacks[QUEEN][s1]  = PseudoAttacks[BISHOP][s1] = attacks_bb<BISHOP>(s1, 0);
-      PseudoAttacks[QUEEN][s1] |= PseudoAttacks[  ROOK][s1] = attacks_bb<  ROOK>(s1, 0);
+      t.PseudoAttacks[QUEEN][s1]  = t.PseudoAttacks[BISHOP][s1] = attacks_bb<BISHOP>(s1, 0);
+      t.PseudoAttacks[QUEEN][s1] |= t.PseudoAttacks[  ROOK][s1] = attacks_bb<  ROOK>(s1, 0);
 
       for (PieceType pt : { BISHOP, ROOK })
           for (Square s2 = SQ_A1; s2 <= SQ_H8; ++s2)
           {
-              if (PseudoAttacks[pt][s1] & s2)
+              if (t.PseudoAttacks[pt][s1] & s2)
               {
-                  LineBB[s1][s2]    = (attacks_bb(pt, s1, 0) & attacks_bb(pt, s2, 0)) | s1 | s2;
-                  BetweenBB[s1][s2] = (attacks_bb(pt, s1, square_bb(s2)) & attacks_bb(pt, s2, square_bb(s1)));
+                  t.LineBB[s1][s2]    = (attacks_bb(pt, s1, 0) & attacks_bb(pt, s2, 0)) | s1 | s2;
+                  t.BetweenBB[s1][s2] = (attacks_bb(pt, s1, square_bb(s2)) & attacks_bb(pt, s2, square_bb(s1)));
               }
-              BetweenBB[s1][s2] |= s2;
+              t.BetweenBB[s1][s2] |= s2;
           }
   }
 }
 
+
+// Bitboards::use_local_tables() makes the calling thread use the copy of the
+// attack tables of the NUMA node it is bound to, see Thread::idle_loop(). The
+// first thread of each node makes the copy, so that its pages are allocated on
+// the node. The copies are kept until the program exits, as other threads may
+// still be using them.
+
+void Bitboards::use_local_tables() {
+
+#ifdef USE_NUMA
+  static std::mutex mutex;
+  static std::map<int, std::unique_ptr<AttackTables>> replicas;
+
+  const int node = WinProcGroup::numa_node();
+
+  if (node < 0)
+      return;
+
+  std::lock_guard<std::mutex> lk(mutex);
+
+  std::unique_ptr<AttackTables>& t = replicas[node];
+
+  if (!t)
+  {
+      t = std::make_unique<AttackTables>(MainTables);
+
+      // Rebase the pointers of the magics into the tables of the copy
+      for (Square s = SQ_A1; s <= SQ_H8; ++s)
+      {
+          t->RookMagics[s].attacks   = t->RookTable   + (MainTables.RookMagics[s].attacks   - MainTables.RookTable);
+          t->BishopMagics[s].attacks = t->BishopTable + (MainTables.BishopMagics[s].attacks - MainTables.BishopTable);
+      }
+  }
+
+  LocalTables = t.get();
+#endif
+}
+
 namespace {
 
   Bitboard sliding_attack(PieceType pt, Square sq, Bitboard occupied) {
@@ -143,7 +182,7 @@ namespace {
   // www.chessprogramming.org/Magic_Bitboards. In particular, here we use the so
   // called "fancy" approach.
 
-  void init_magics(PieceType pt, Bitboard table[], Magic magics[]) {
+  void init_magics(PieceType pt, SliderAttacks table[], Magic magics[]) {
 
     // Optimal PRNG seeds to pick the correct magics in the shortest time
     int seeds[][RANK_NB] = { { 8977, 44560, 54343, 38998,  5731, 95205, 104912, 17020 },
@@ -163,7 +202,8 @@ namespace {
         // the number of 1s of the mask. Hence we deduce the size of the shift to
         // apply to the 64 or 32 bits word to get the index.
         Magic& m = magics[s];
-        m.mask  = sliding_attack(pt, s, 0) & ~edges;
+        m.rays  = sliding_attack(pt, s, 0);
+        m.mask  = m.rays & ~edges;
         m.shift = (Is64Bit ? 64 : 32) - popcount(m.mask);
 
         // Set the offset for the attacks table of the square. We have individual
@@ -177,8 +217,11 @@ namespace {
             occupancy[size] = b;
             reference[size] = sliding_attack(pt, s, b);
 
-            if (HasPext)
-                m.attacks[pext(b, m.mask)] = reference[size];
+            if (HasPdep)
+                m.attacks[pext(b, m.mask)] = SliderAttacks(pext(reference[size], m.rays));
+
+            else if (HasPext)
+                m.attacks[pext(b, m.mask)] = SliderAttacks(reference[size]);
 
             size++;
             b = (b - m.mask) & m.mask;
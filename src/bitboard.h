@@ -20,6 +20,7 @@
 #define BITBOARD_H_INCLUDED
 
 #include <string>
+#include <type_traits>
 
 #include "types.h"
 
@@ -35,6 +36,7 @@ bool probe(Square wksq, Square wpsq, Square bksq, Color us);
 namespace Bitboards {
 
 void init();
+void use_local_tables();
 std::string pretty(Bitboard b);
 
 } // namespace Stockfish::Bitboards
@@ -75,17 +77,19 @@ extern uint8_t PopCnt16[1 << 16];
 extern uint8_t SquareDistance[SQUARE_NB][SQUARE_NB];
 
 extern Bitboard SquareBB[SQUARE_NB];
-extern Bitboard BetweenBB[SQUARE_NB][SQUARE_NB];
-extern Bitboard LineBB[SQUARE_NB][SQUARE_NB];
-extern Bitboard PseudoAttacks[PIECE_TYPE_NB][SQUARE_NB];
-extern Bitboard PawnAttacks[COLOR_NB][SQUARE_NB];
 
 
+// With pdep the slider attacks are stored compressed: the attacked squares as a
+// 16 bit subset of the attacks on an empty board. This makes the tables 4 times
+// smaller, about 200 KB for the rooks, so that they stay in the L2 cache.
+using SliderAttacks = std::conditional_t<HasPdep, uint16_t, Bitboard>;
+
 // Magic holds all magic bitboards relevant data for a single square
 struct Magic {
   Bitboard  mask;
   Bitboard  magic;
-  Bitboard* attacks;
+  Bitboard  rays; // Attacks on an empty board, used to expand the compressed attacks
+  SliderAttacks* attacks;
   unsigned  shift;
 
   // Compute the attack's index using the 'magic bitboards' approach
@@ -101,10 +105,45 @@ struct Magic {
     unsigned hi = unsigned(occupied >> 32) & unsigned(mask >> 32);
     return (lo * unsigned(magic) ^ hi * unsigned(magic >> 32)) >> shift;
   }
+
+  // Look up the attacks for the given occupancy
+  Bitboard attacks_bb(Bitboard occupied) const {
+
+    if (HasPdep)
+        return pdep(attacks[index(occupied)], rays);
+
+    return attacks[index(occupied)];
+  }
+};
+
+// AttackTables holds the read-only attack tables. With -DUSE_NUMA and the NUMA
+// Replicate option each NUMA node has its own copy, used by the threads running
+// on the node, see Bitboards::use_local_tables().
+struct AttackTables {
+  Bitboard LineBB[SQUARE_NB][SQUARE_NB];
+  Bitboard BetweenBB[SQUARE_NB][SQUARE_NB];
+  Bitboard PseudoAttacks[PIECE_TYPE_NB][SQUARE_NB];
+  Bitboard PawnAttacks[COLOR_NB][SQUARE_NB];
+  Magic RookMagics[SQUARE_NB];
+  Magic BishopMagics[SQUARE_NB];
+  SliderAttacks RookTable[0x19000];  // To store rook attacks
+  SliderAttacks BishopTable[0x1480]; // To store bishop attacks
 };
 
-extern Magic RookMagics[SQUARE_NB];
-extern Magic BishopMagics[SQUARE_NB];
+extern AttackTables MainTables;
+
+#ifdef USE_NUMA
+extern thread_local const AttackTables* LocalTables;
+#endif
+
+// tables() returns the attack tables of the current thread
+inline const AttackTables& tables() {
+#ifdef USE_NUMA
+  return *LocalTables;
+#else
+  return MainTables;
+#endif
+}
 
 inline Bitboard square_bb(Square s) {
   assert(is_ok(s));
@@ -182,7 +221,7 @@ constexpr Bitboard pawn_attacks_bb(Bitboard b) {
 inline Bitboard pawn_attacks_bb(Color c, Square s) {
 
   assert(is_ok(s));
-  return PawnAttacks[c][s];
+  return tables().PawnAttacks[c][s];
 }
 
 
@@ -213,7 +252,7 @@ inline Bitboard line_bb(Square s1, Square s2) {
 
   assert(is_ok(s1) && is_ok(s2));
 
-  return LineBB[s1][s2];
+  return tables().LineBB[s1][s2];
 }
 
 
@@ -229,7 +268,7 @@ inline Bitboard between_bb(Square s1, Square s2) {
 
   assert(is_ok(s1) && is_ok(s2));
 
-  return BetweenBB[s1][s2];
+  return tables().BetweenBB[s1][s2];
 }
 
 
@@ -296,7 +335,7 @@ inline Bitboard attacks_bb(Square s) {
 
   assert((Pt != PAWN) && (is_ok(s)));
 
-  return PseudoAttacks[Pt][s];
+  return tables().PseudoAttacks[Pt][s];
 }
 
 
@@ -311,10 +350,10 @@ inline Bitboard attacks_bb(Square s, Bitboard occupied) {
 
   switch (Pt)
   {
-  case BISHOP: return BishopMagics[s].attacks[BishopMagics[s].index(occupied)];
-  case ROOK  : return   RookMagics[s].attacks[  RookMagics[s].index(occupied)];
+  case BISHOP: return tables().BishopMagics[s].attacks_bb(occupied);
+  case ROOK  : return   tables().RookMagics[s].attacks_bb(occupied);
   case QUEEN : return attacks_bb<BISHOP>(s, occupied) | attacks_bb<ROOK>(s, occupied);
-  default    : return PseudoAttacks[Pt][s];
+  default    : return tables().PseudoAttacks[Pt][s];
   }
 }
 
@@ -327,7 +366,7 @@ inline Bitboard attacks_bb(PieceType pt, Square s, Bitboard occupied) {
   case BISHOP: return attacks_bb<BISHOP>(s, occupied);
   case ROOK  : return attacks_bb<  ROOK>(s, occupied);
   case QUEEN : return attacks_bb<BISHOP>(s, occupied) | attacks_bb<ROOK>(s, occupied);
-  default    : return PseudoAttacks[pt][s];
+  default    : return tables().PseudoAttacks[pt][s];
   }
 }
 
@@ -0,0 +1,350 @@
+/*
+  Stockfish, a UCI chess playing engine derived from Glaurung 2.1
+  Copyright (C) 2004-2024 The Stockfish developers (see AUTHORS file)
+
+  Stockfish is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Stockfish is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <algorithm>
+#include <atomic>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "datagen.h"
+#include "misc.h"
+#include "movegen.h"
+#include "position.h"
+#include "search.h"
+#include "thread.h"
+#include "tt.h"
+#include "uci.h"
+#include "syzygy/tbprobe.h"
+
+namespace Stockfish::DataGen {
+
+namespace {
+
+  const char* StartFEN = "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1";
+
+  struct Params {
+    uint64_t games = 1000;
+    uint64_t nodes = 5000;
+    size_t shards = 0;  // One shard per search thread by default
+    int randomPlies = 8;
+    int maxPly = 400;
+    uint64_t seed = 1;
+    std::string out = "datagen";
+  };
+
+  Params Current; // Parameters of the run in progress
+  TimePoint Start;
+  std::atomic<TimePoint> LastReport;
+  std::atomic<size_t> NextShard, Running;
+  std::atomic<uint64_t> Games, Positions, Nodes;
+
+
+  std::string shard_name(const Params& p, size_t shard) {
+    return p.out + "." + std::to_string(shard) + ".bin";
+  }
+
+
+  // game_seed() derives the seed of the opening of each game from the seed of
+  // the run, so that a restarted run does not replay the openings of a shard.
+
+  uint64_t game_seed(uint64_t seed, size_t shard, uint64_t game) {
+
+    uint64_t s = (seed * 0x9E3779B97F4A7C15ULL) ^ (uint64_t(shard) << 40) ^ game;
+    s = (s ^ (s >> 31)) * 0xBF58476D1CE4E5B9ULL;
+    return (s ^ (s >> 29)) | 1; // PRNG seeds must not be zero
+  }
+
+
+  PackedPosition pack(const Position& pos) {
+
+    PackedPosition pp = {};
+    pp.occupied = pos.pieces();
+
+    int i = 0;
+    for (Bitboard b = pp.occupied; b; ++i)
+        pp.pieces[i / 2] |= uint8_t(pos.piece_on(pop_lsb(b)) << (4 * (i & 1)));
+
+    // SQ_NONE is 64, as the format expects when there is no en passant square
+    pp.stmEp  = uint8_t((pos.side_to_move() << 7) | int(pos.ep_square()));
+    pp.flags  = uint8_t(pos.castling_rights(WHITE) | pos.castling_rights(BLACK));
+    pp.rule50 = uint8_t(std::min(pos.rule50_count(), 255));
+
+    return pp;
+  }
+
+
+  // game_result() returns the result for white of a finished game, 0 for a loss,
+  // 1 for a draw and 2 for a win, or -1 if the game goes on. Threefold
+  // repetitions, the 50-move rule, bare kings and games reaching maxPly are draws.
+
+  int game_result(const Position& pos, int maxPly) {
+
+    if (!pos.has_legal_move())
+        return !pos.checkers() ? 1 : pos.side_to_move() == WHITE ? 0 : 2;
+
+    if (pos.is_draw(0) || pos.count<ALL_PIECES>() == 2 || pos.game_ply() >= maxPly)
+        return 1;
+
+    return -1;
+  }
+
+
+  // search() searches the position on the given thread alone, up to the
+  // node limit of the thread, in the same way as start_thinking() sets up
+  // a search of the thread pool.
+
+  const Search::RootMove& search(Thread* th, const Position& pos) {
+
+    th->rootMoves.clear();
+    for (const auto& m : MoveList<LEGAL>(pos))
+        th->rootMoves.emplace_back(m);
+
+    th->rootPos.set(pos, &th->rootState, th);
+    th->nodes = th->tbHits = th->bestMoveChanges = 0;
+    th->nmpMinPly = 0;
+    th->rootDepth = th->completedDepth = 0;
+    th->limitReached = false;
+
+    th->Thread::search();
+
+    Nodes += th->nodes;
+
+    return th->rootMoves[0];
+  }
+
+
+  // play_game() plays a game on the given thread from a random opening and
+  // appends the searched positions to 'records'. The game ends as soon as the
+  // search finds a mate or a tablebase win. It returns false if the run is
+  // stopped before the end of the game.
+
+  bool play_game(Thread* th, const Params& p, PRNG& rng, std::vector<PackedPosition>& records) {
+
+    StateListPtr states;
+    Position pos;
+
+    do {
+        states = StateListPtr(new std::deque<StateInfo>(1));
+        pos.set(StartFEN, false, &states->back(), th);
+
+        for (int ply = 0; ply < p.randomPlies && pos.has_legal_move(); ++ply)
+        {
+            MoveList<LEGAL> moves(pos);
+            states->emplace_back();
+            pos.do_move(*(moves.begin() + rng.rand<uint64_t>() % moves.size()), states->back());
+        }
+    } while (game_result(pos, p.maxPly) != -1);
+
+    th->clear();
+    TT.new_search(); // Let the entries of the previous games age out
+
+    size_t first = records.size();
+    int result;
+
+    while ((result = game_result(pos, p.maxPly)) == -1)
+    {
+        const Search::RootMove& rm = search(th, pos);
+
+        if (Threads.stop)
+            return false;
+
+        Value score = rm.score != -VALUE_INFINITE ? rm.score : rm.previousScore;
+
+        PackedPosition pp = pack(pos);
+        pp.score = int16_t(score);
+        pp.move = rm.pv[0].raw();
+        records.push_back(pp);
+
+        if (std::abs(score) >= VALUE_TB_WIN_IN_MAX_PLY)
+        {
+            result = (score > 0) == (pos.side_to_move() == WHITE) ? 2 : 0;
+            break;
+        }
+
+        states->emplace_back();
+        pos.do_move(rm.pv[0], states->back());
+    }
+
+    for (size_t i = first; i < records.size(); ++i)
+        records[i].result = uint8_t(records[i].stmEp >> 7 ? 2 - result : result);
+
+    records.back().flags |= LastPosition;
+
+    return true;
+  }
+
+
+  // resume() returns the number of games already written to a shard by a
+  // previous run, and cuts off the records of an interrupted game, if any.
+
+  uint64_t resume(const std::string& name) {
+
+    std::ifstream in(name, std::ios::binary);
+
+    if (!in)
+        return 0;
+
+    std::vector<PackedPosition> buf(4096);
+    uint64_t games = 0, records = 0, complete = 0;
+
+    do {
+        in.read(reinterpret_cast<char*>(buf.data()), std::streamsize(buf.size() * sizeof(PackedPosition)));
+
+        for (size_t i = 0; i < size_t(in.gcount()) / sizeof(PackedPosition); ++i)
+        {
+            ++records;
+
+            if (buf[i].flags & LastPosition)
+                ++games, complete = records;
+        }
+
+    } while (in);
+
+    in.close();
+
+    std::error_code ec;
+    std::filesystem::resize_file(name, complete * sizeof(PackedPosition), ec);
+
+    return games;
+  }
+
+
+  void report(const Params& p, TimePoint start) {
+
+    TimePoint elapsed = now() - start + 1; // Ensure positivity to avoid a 'divide by zero'
+
+    sync_cout << "info string datagen games " << Games << " of " << p.games
+              << " positions " << Positions
+              << " time " << elapsed
+              << " positions/s " << Positions * 1000 / elapsed
+              << " nps " << Nodes * 1000 / elapsed << sync_endl;
+  }
+
+
+  // worker() is run by each search thread. It takes the shards one at a time
+  // and plays the missing games of each, flushing every game as it ends. An
+  // unfinished game is dropped when the run is stopped. The workers report
+  // the progress every 10 seconds, and the last one to finish the final count.
+
+  void worker(Thread* th, const Params& p) {
+
+    std::vector<PackedPosition> records;
+    size_t shard;
+
+    th->nodesLimit = p.nodes;
+
+    while (!Threads.stop && (shard = NextShard++) < p.shards)
+    {
+        const std::string name = shard_name(p, shard);
+        const uint64_t target = p.games / p.shards + (shard < p.games % p.shards);
+        uint64_t game = resume(name);
+        std::ofstream out(name, std::ios::binary | std::ios::app);
+
+        if (!out)
+        {
+            sync_cout << "info string Could not open " << name << sync_endl;
+            continue;
+        }
+
+        Games += std::min(game, target);
+
+        for ( ; game < target && !Threads.stop; ++game)
+        {
+            PRNG rng(game_seed(p.seed, shard, game));
+
+            records.clear();
+            if (!play_game(th, p, rng, records))
+                break;
+
+            out.write(reinterpret_cast<const char*>(records.data()),
+                      std::streamsize(records.size() * sizeof(PackedPosition)));
+            out.flush();
+
+            ++Games;
+            Positions += records.size();
+
+            TimePoint last = LastReport;
+            if (now() - last >= 10000 && LastReport.compare_exchange_strong(last, now()))
+                report(p, Start);
+        }
+    }
+
+    th->nodesLimit = 0;
+    th->limitReached = false;
+
+    if (--Running == 0)
+        report(p, Start);
+  }
+
+} // namespace
+
+
+// DataGen::run() is called by the 'datagen' command. The games are divided
+// over 'shards' output files, and each search thread plays the games of one
+// shard at a time, with the given number of nodes per move. It returns once
+// the threads are started, so that 'stop' and 'quit' can end the run. Running
+// the same command again completes the shards, so a stopped run can be restarted.
+
+void run(std::istringstream& is) {
+
+  Params p;
+  std::string token;
+
+  while (is >> token)
+      if (token == "games")            is >> p.games;
+      else if (token == "nodes")       is >> p.nodes;
+      else if (token == "shards")      is >> p.shards;
+      else if (token == "randomplies") is >> p.randomPlies;
+      else if (token == "maxply")      is >> p.maxPly;
+      else if (token == "seed")        is >> p.seed;
+      else if (token == "out")         is >> p.out;
+
+  p.shards = p.shards ? p.shards : Threads.size();
+  p.nodes = std::max(p.nodes, uint64_t(1));
+  p.maxPly = std::max(p.maxPly, p.randomPlies + 1);
+
+  Search::clear();
+  Threads.wait_for_idle();
+
+  // The threads search on their own, so reset what start_thinking() and
+  // Tablebases::rank_root_moves() set up
+  Search::Limits = Search::LimitsType();
+  Search::Limits.startTime = now();
+  Threads.stop = false;
+  Threads.deterministic = false;
+  Threads.increaseDepth = true;
+  TT.set_deterministic(0);
+  TT.set_policy(Options["TT Replace"] == "Mate" ? RP_MATE_PROOF : RP_DEPTH_AGE);
+  Tablebases::set_probe_limits();
+
+  size_t workers = std::min(Threads.size(), p.shards);
+
+  Current = p;
+  NextShard = 0;
+  Running = workers;
+  Games = Positions = Nodes = 0;
+  Start = LastReport = now();
+
+  for (size_t i = 0; i < workers; ++i)
+      Threads[i]->run_custom_job([th = Threads[i]]() { worker(th, Current); });
+}
+
+} // namespace Stockfish::DataGen
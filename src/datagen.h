@@ -0,0 +1,53 @@
+/*
+  Stockfish, a UCI chess playing engine derived from Glaurung 2.1
+  Copyright (C) 2004-2024 The Stockfish developers (see AUTHORS file)
+
+  Stockfish is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Stockfish is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef DATAGEN_H_INCLUDED
+#define DATAGEN_H_INCLUDED
+
+#include <cstdint>
+#include <sstream>
+
+namespace Stockfish::DataGen {
+
+// A PackedPosition is the 32-byte record written for each searched position,
+// in little-endian byte order. The pieces of the occupied squares are stored
+// from a1 to h8, one Piece value in each nibble, low nibble first.
+
+struct PackedPosition {
+  uint64_t occupied;
+  uint8_t  pieces[16];
+  uint8_t  stmEp;    // Side to move in bit 7, en passant square or 64 in bits 0-6
+  uint8_t  flags;    // Castling rights in bits 0-3, LastPosition on the last record of a game
+  uint8_t  rule50;
+  uint8_t  result;   // Game result for the side to move: 0 loss, 1 draw, 2 win
+  int16_t  score;    // Search score for the side to move, in internal units
+  uint16_t move;     // Best move, in the Move encoding
+};
+
+static_assert(sizeof(PackedPosition) == 32, "PackedPosition must be 32 bytes");
+
+constexpr uint8_t LastPosition = 0x80;
+
+// run() plays self-play games on all the search threads, as described by the
+// parameters of the 'datagen' command, and writes their positions to the shards.
+
+void run(std::istringstream& is);
+
+} // namespace Stockfish::DataGen
+
+#endif // #ifndef DATAGEN_H_INCLUDED
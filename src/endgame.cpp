@@ -20,7 +20,6 @@
 
 #include "bitboard.h"
 #include "endgame.h"
-#include "movegen.h"
 
 namespace Stockfish {
 
@@ -102,7 +101,7 @@ namespace Stockfish {
         assert(!pos.checkers()); // Eval is never called when in check
 
         // Stalemate detection with lone king
-        if (pos.side_to_move() == weakSide && !MoveList<LEGAL>(pos).size())
+        if (pos.side_to_move() == weakSide && !pos.has_legal_move())
             return VALUE_DRAW;
 
         Square strongKing = pos.square<KING>(strongSide);
@@ -20,6 +20,7 @@
 
 #include "bitboard.h"
 #include "endgame.h"
+#include "metrics.h"
 #include "position.h"
 #include "psqt.h"
 #include "search.h"
@@ -47,6 +48,7 @@ int main(int argc, char* argv[]) {
 
   UCI::loop(argc, argv);
 
+  Metrics::serve(0);
   Threads.set(0);
   return 0;
 }
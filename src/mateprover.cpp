@@ -0,0 +1,298 @@
+/*
+  Stockfish, a UCI chess playing engine derived from Glaurung 2.1
+  Copyright (C) 2004-2024 The Stockfish developers (see AUTHORS file)
+
+  Stockfish is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Stockfish is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <algorithm>
+
+#include "mateprover.h"
+#include "movegen.h"
+#include "thread.h"
+
+namespace Stockfish::MateProver {
+
+namespace {
+
+  // The prover gives up after this many nodes and leaves the position to the
+  // normal mate search, which also finds mates with quiet moves.
+  constexpr uint64_t MaxNodes = 1 << 18;
+
+  // The mate TT stores, for positions with the attacker to move, the shortest
+  // mate proven and the longest length known to have no checks-only mate.
+  struct Entry {
+    Key key;
+    uint8_t proven;    // Mate in at most 'proven' moves, 0 if none is known
+    uint8_t disproven; // No mate in 'disproven' moves or less
+  };
+
+  constexpr size_t TableSize = 1 << 20; // 16 MB
+
+  std::vector<Entry> Table;
+
+
+  // The Prover walks the tree in which the attacker plays only checks and
+  // the defender plays all legal replies. There is no pruning at all, so a
+  // success is an exact proof of the mate.
+
+  class Prover {
+
+  public:
+    Prover(Position& p, const Search::RootMoves& rm) : pos(p), rootMoves(rm) {}
+
+    bool attack(int n);
+    bool defend(int n);
+    void extract_pv(int n, std::vector<Move>& pv);
+
+    Move rootMove = Move::none();
+    bool aborted = false;
+
+  private:
+    int checks(ExtMove* list);
+    Entry* probe() { return &Table[pos.key() & (TableSize - 1)]; }
+
+    Position& pos;
+    const Search::RootMoves& rootMoves;
+    uint64_t nodes = 0;
+    int ply = 0;
+  };
+
+
+  // Prover::checks() generates the checking moves of the attacker, sorted by
+  // the number of legal replies. A move with no replies is a mate, and fewer
+  // replies mean a smaller tree to prove, so we try those first.
+
+  int Prover::checks(ExtMove* list) {
+
+    int cnt = 0;
+    StateInfo st;
+
+    for (const auto& m : MoveList<LEGAL>(pos))
+    {
+        if (   !pos.gives_check(m)
+            || (ply == 0 && std::find(rootMoves.begin(), rootMoves.end(), m) == rootMoves.end()))
+            continue;
+
+        pos.do_move(m, st, true);
+        list[cnt] = m;
+        list[cnt++].value = int(MoveList<LEGAL>(pos).size());
+        pos.undo_move(m);
+    }
+
+    std::stable_sort(list, list + cnt);
+
+    return cnt;
+  }
+
+
+  // Prover::attack() returns true if the side to move mates in at most n moves
+  // giving check at every move.
+
+  bool Prover::attack(int n) {
+
+    Entry* e = probe();
+
+    if (e->key == pos.key())
+    {
+        if (e->proven && e->proven <= n)
+            return true;
+
+        if (e->disproven >= n)
+            return false;
+    }
+
+    // Check for the available remaining time
+    Threads.main()->check_time();
+
+    if (++nodes > MaxNodes || Threads.stop.load(std::memory_order_relaxed))
+        aborted = true;
+
+    if (aborted)
+        return false;
+
+    ExtMove list[MAX_MOVES];
+    int cnt = checks(list), proven = 0;
+    StateInfo st;
+
+    for (int i = 0; i < cnt && !proven; ++i)
+    {
+        if (list[i].value == 0)
+            proven = 1;
+
+        else if (n > 1)
+        {
+            pos.do_move(list[i], st, true);
+            ++ply;
+            bool mated = defend(n - 1);
+            --ply;
+            pos.undo_move(list[i]);
+
+            if (mated)
+                proven = n;
+        }
+
+        if (proven && ply == 0)
+            rootMove = list[i];
+    }
+
+    if (aborted)
+        return false;
+
+    e = probe(); // Replaced meanwhile, or not
+    if (e->key != pos.key())
+        *e = { pos.key(), 0, 0 };
+
+    if (proven)
+        e->proven = uint8_t(proven);
+    else
+        e->disproven = uint8_t(std::max(int(e->disproven), n));
+
+    return proven;
+  }
+
+
+  // Prover::defend() returns true if all the legal replies of the side to move,
+  // which is in check and not mated, lose to a checks-only mate in n moves.
+
+  bool Prover::defend(int n) {
+
+    StateInfo st;
+    MoveList<LEGAL> replies(pos);
+
+    // Look first for a reply already known to escape, typically from the
+    // previous iteration. key_after() may miss a few key changes, but then
+    // the worst case is a missed proof, never a wrong one.
+    for (const auto& m : replies)
+    {
+        const Entry& e = Table[pos.key_after(m) & (TableSize - 1)];
+
+        if (e.key == pos.key_after(m) && e.disproven >= n)
+            return false;
+    }
+
+    for (const auto& m : replies)
+    {
+        pos.do_move(m, st);
+        ++ply;
+        bool mated = attack(n);
+        --ply;
+        pos.undo_move(m);
+
+        if (!mated)
+            return false;
+    }
+
+    return true;
+  }
+
+
+  // Prover::extract_pv() appends to pv a mating line of at most n moves,
+  // choosing for the defender the reply that delays the mate the longest.
+  // Most of the positions are found in the mate TT.
+
+  void Prover::extract_pv(int n, std::vector<Move>& pv) {
+
+    ExtMove list[MAX_MOVES];
+    int cnt = checks(list);
+
+    if (cnt && list[0].value == 0)
+    {
+        pv.push_back(list[0]);
+        return;
+    }
+
+    for (int i = 0; i < cnt && n > 1; ++i)
+    {
+        StateInfo st, st2;
+        Move bestReply = Move::none();
+        int bestLength = 0;
+
+        pos.do_move(list[i], st, true);
+        ++ply;
+
+        if (defend(n - 1))
+            for (const auto& m : MoveList<LEGAL>(pos))
+            {
+                pos.do_move(m, st2);
+                ++ply;
+
+                int length = 1;
+                while (length < n - 1 && !attack(length))
+                    ++length;
+
+                --ply;
+                pos.undo_move(m);
+
+                if (length > bestLength)
+                    bestLength = length, bestReply = m;
+            }
+
+        if (bestReply != Move::none())
+        {
+            pv.push_back(list[i]);
+            pv.push_back(bestReply);
+
+            pos.do_move(bestReply, st2);
+            ++ply;
+            extract_pv(bestLength, pv);
+            --ply;
+            pos.undo_move(bestReply);
+        }
+
+        --ply;
+        pos.undo_move(list[i]);
+
+        if (bestReply != Move::none())
+            return;
+    }
+  }
+
+} // namespace
+
+
+// MateProver::search() runs the prover by iterative deepening on the mate
+// length, so the first mate found is the shortest checks-only mate.
+
+int search(Position& pos, const Search::RootMoves& rootMoves, int maxMoves, std::vector<Move>& pv) {
+
+  // With no capture or pawn move the 50-move rule could end the game before
+  // the mate, and the mate TT does not take the counter into account.
+  if (maxMoves <= 0 || pos.rule50_count() + 2 * maxMoves > 100)
+      return 0;
+
+  if (Table.empty())
+      Table.resize(TableSize);
+
+  std::fill(Table.begin(), Table.end(), Entry());
+
+  Prover prover(pos, rootMoves);
+
+  for (int n = 1; n <= maxMoves && !prover.aborted; ++n)
+      if (prover.attack(n))
+      {
+          pv.clear();
+          prover.extract_pv(n, pv);
+
+          // The PV may be cut short if the prover runs out of nodes meanwhile
+          if (pv.empty() || pv[0] != prover.rootMove)
+              pv.assign(1, prover.rootMove);
+
+          return n;
+      }
+
+  return 0;
+}
+
+} // namespace Stockfish::MateProver
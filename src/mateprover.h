@@ -0,0 +1,37 @@
+/*
+  Stockfish, a UCI chess playing engine derived from Glaurung 2.1
+  Copyright (C) 2004-2024 The Stockfish developers (see AUTHORS file)
+
+  Stockfish is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Stockfish is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef MATEPROVER_H_INCLUDED
+#define MATEPROVER_H_INCLUDED
+
+#include <vector>
+
+#include "position.h"
+#include "search.h"
+
+namespace Stockfish::MateProver {
+
+// search() tries to prove a mate in at most maxMoves moves for the side to move,
+// playing only checking moves. On success it returns the length of the mate in
+// moves and fills pv, otherwise it returns 0 and the normal search must be used.
+
+int search(Position& pos, const Search::RootMoves& rootMoves, int maxMoves, std::vector<Move>& pv);
+
+} // namespace Stockfish::MateProver
+
+#endif // #ifndef MATEPROVER_H_INCLUDED
@@ -0,0 +1,269 @@
+/*
+  Stockfish, a UCI chess playing engine derived from Glaurung 2.1
+  Copyright (C) 2004-2024 The Stockfish developers (see AUTHORS file)
+
+  Stockfish is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Stockfish is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <algorithm>
+#include <atomic>
+#include <iostream>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+
+#include "metrics.h"
+
+#ifndef _WIN32
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/select.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#else
+#define WIN32_LEAN_AND_MEAN
+#ifndef NOMINMAX
+#  define NOMINMAX // Disable macros min() and max()
+#endif
+#include <winsock2.h>
+#ifdef _MSC_VER
+#pragma comment(lib, "ws2_32.lib")
+#endif
+#endif
+
+namespace Stockfish::Metrics {
+
+namespace {
+
+#ifndef _WIN32
+  using Socket = int;
+  constexpr Socket NoSocket = -1;
+  void close_socket(Socket s) { close(s); }
+#else
+  using Socket = SOCKET;
+  constexpr Socket NoSocket = INVALID_SOCKET;
+  void close_socket(Socket s) { closesocket(s); }
+#endif
+
+  // A client closing the connection early must not raise SIGPIPE
+#ifdef MSG_NOSIGNAL
+  constexpr int SendFlags = MSG_NOSIGNAL;
+#else
+  constexpr int SendFlags = 0;
+#endif
+
+  // Totals sums all the searches since the start, Last is the last search,
+  // which the gauges are computed from.
+  std::mutex StatsMutex;
+  SearchStats Totals, Last;
+  uint64_t Searches, HelperBest;
+
+  std::thread Server;
+  std::atomic_bool Exit;
+
+
+  // ready() waits at most the given time for a socket to be readable, or for a
+  // listening socket to have a connection to accept.
+
+  bool ready(Socket s, int ms) {
+
+    fd_set set;
+    FD_ZERO(&set);
+    FD_SET(s, &set);
+    timeval tv = { ms / 1000, (ms % 1000) * 1000 };
+
+    return select(int(s) + 1, &set, nullptr, nullptr, &tv) > 0;
+  }
+
+
+  // metrics() formats the metrics in the Prometheus text exposition format
+
+  std::string metrics() {
+
+    SearchStats t, l;
+    uint64_t searches, helperBest;
+
+    {
+        std::lock_guard<std::mutex> lk(StatsMutex);
+        t = Totals, l = Last, searches = Searches, helperBest = HelperBest;
+    }
+
+    std::ostringstream ss;
+    ss.precision(15);
+
+    auto metric = [&](const char* name, const char* type, const char* help, auto value) {
+        ss << "# HELP stockfish_" << name << " " << help << "\n"
+           << "# TYPE stockfish_" << name << " " << type << "\n"
+           << "stockfish_" << name << " " << value << "\n";
+    };
+
+    metric("searches_total",               "counter", "Searches served.", searches);
+    metric("nodes_total",                  "counter", "Nodes searched.", t.nodes);
+    metric("tbhits_total",                 "counter", "Tablebase hits.", t.tbHits);
+    metric("tt_probes_total",              "counter", "Transposition table probes.", t.ttProbes);
+    metric("tt_hits_total",                "counter", "Transposition table hits.", t.ttHits);
+    metric("search_seconds_total",         "counter", "Time spent searching.", t.time / 1000.0);
+    metric("stop_overshoot_seconds_total", "counter", "Time used beyond the movetime or the maximum time.", t.overshoot / 1000.0);
+    metric("thread_busy_seconds_total",    "counter", "Time spent searching, summed over the threads.", t.busyTime / 1000.0);
+    metric("best_thread_helper_total",     "counter", "Searches whose best move was taken from a helper thread.", helperBest);
+    metric("tt_foreign_hits_total",        "counter", "TT hits on entries created by another thread in the same search, with SMPStats.", t.foreignHits);
+
+    metric("nps",                    "gauge", "Nodes per second of the last search.", l.nodes * 1000 / std::max(l.time, TimePoint(1)));
+    metric("tt_hashfull_permille",   "gauge", "Transposition table usage after the last search.", l.hashfull);
+    metric("tt_hit_ratio",           "gauge", "Transposition table hit ratio of the last search.", double(l.ttHits) / std::max(l.ttProbes, uint64_t(1)));
+    metric("search_seconds",         "gauge", "Time of the last search.", l.time / 1000.0);
+    metric("stop_overshoot_seconds", "gauge", "Time the last search used beyond the movetime or the maximum time.", l.overshoot / 1000.0);
+    metric("threads",                "gauge", "Threads of the last search.", l.threads);
+    metric("duplicate_node_ratio",   "gauge", "Share of the nodes of the last search that were foreign TT hits, with SMPStats.",
+           double(l.foreignHits) / std::max(l.nodes, uint64_t(1)));
+    metric("thread_utilization",     "gauge", "Share of the last search time the threads were searching.",
+           double(l.busyTime) / std::max(l.time * TimePoint(l.threads), TimePoint(1)));
+
+    return ss.str();
+  }
+
+
+  // answer() reads an HTTP request and sends the metrics for 'GET /metrics',
+  // or a 404 error. The connection is closed after each request.
+
+  void answer(Socket client) {
+
+    std::string request;
+    char buf[1024];
+
+    while (   request.find("\r\n\r\n") == std::string::npos
+           && request.size() < 8192
+           && ready(client, 1000))
+    {
+        int n = int(recv(client, buf, sizeof(buf), 0));
+        if (n <= 0)
+            break;
+
+        request.append(buf, size_t(n));
+    }
+
+    bool found = request.compare(0, 12, "GET /metrics") == 0;
+    std::string body = found ? metrics() : "Not found\n";
+    std::string response = std::string(found ? "HTTP/1.1 200 OK\r\n" : "HTTP/1.1 404 Not Found\r\n")
+                         + "Content-Type: text/plain; version=0.0.4\r\n"
+                         + "Content-Length: " + std::to_string(body.size()) + "\r\n"
+                         + "Connection: close\r\n\r\n" + body;
+
+    for (size_t sent = 0; sent < response.size(); )
+    {
+        int n = int(send(client, response.data() + sent, int(response.size() - sent), SendFlags));
+        if (n <= 0)
+            break;
+
+        sent += size_t(n);
+    }
+  }
+
+
+  // run() is the loop of the server thread. It checks the exit flag every
+  // 100 ms while waiting for connections.
+
+  void run(Socket listener) {
+
+    while (!Exit)
+        if (ready(listener, 100))
+        {
+            Socket client = accept(listener, nullptr, nullptr);
+
+            if (client != NoSocket)
+            {
+#ifdef SO_NOSIGPIPE
+                int one = 1;
+                setsockopt(client, SOL_SOCKET, SO_NOSIGPIPE, &one, sizeof(one));
+#endif
+                answer(client);
+                close_socket(client);
+            }
+        }
+
+    close_socket(listener);
+  }
+
+} // namespace
+
+
+// Metrics::record() adds a finished search to the metrics. Called by the main
+// thread at the end of each search.
+
+void record(const SearchStats& s) {
+
+  std::lock_guard<std::mutex> lk(StatsMutex);
+
+  Totals.nodes       += s.nodes;
+  Totals.tbHits      += s.tbHits;
+  Totals.ttProbes    += s.ttProbes;
+  Totals.ttHits      += s.ttHits;
+  Totals.foreignHits += s.foreignHits;
+  Totals.time        += s.time;
+  Totals.overshoot   += s.overshoot;
+  Totals.busyTime    += s.busyTime;
+  Last = s;
+  ++Searches;
+  HelperBest += s.helperBest;
+}
+
+
+// Metrics::serve() stops the running server, if any, and then listens on the
+// given port of the loopback interface only.
+
+void serve(int port) {
+
+  if (Server.joinable())
+  {
+      Exit = true;
+      Server.join();
+  }
+
+  if (!port)
+      return;
+
+#ifdef _WIN32
+  static WSADATA wsaData;
+  static bool wsaStarted = !WSAStartup(MAKEWORD(2, 2), &wsaData);
+  (void)wsaStarted;
+#endif
+
+  Socket listener = socket(AF_INET, SOCK_STREAM, 0);
+  sockaddr_in addr = {};
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(uint16_t(port));
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+  int one = 1;
+
+  if (   listener == NoSocket
+      || setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, reinterpret_cast<const char*>(&one), sizeof(one))
+      || bind(listener, reinterpret_cast<const sockaddr*>(&addr), sizeof(addr))
+      || listen(listener, 16))
+  {
+      if (listener != NoSocket)
+          close_socket(listener);
+
+      sync_cout << "info string Metrics server could not listen on port " << port << sync_endl;
+      return;
+  }
+
+  Exit = false;
+  Server = std::thread(run, listener);
+
+  sync_cout << "info string Metrics served at http://127.0.0.1:" << port << "/metrics" << sync_endl;
+}
+
+} // namespace Stockfish::Metrics
@@ -0,0 +1,50 @@
+/*
+  Stockfish, a UCI chess playing engine derived from Glaurung 2.1
+  Copyright (C) 2004-2024 The Stockfish developers (see AUTHORS file)
+
+  Stockfish is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Stockfish is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef METRICS_H_INCLUDED
+#define METRICS_H_INCLUDED
+
+#include <cstdint>
+
+#include "misc.h"
+
+namespace Stockfish::Metrics {
+
+// SearchStats holds what a finished search adds to the metrics. Times are in
+// milliseconds, busyTime is summed over the search threads.
+
+struct SearchStats {
+  uint64_t nodes, tbHits, ttProbes, ttHits;
+  uint64_t foreignHits; // TT hits on entries created by another thread, with SMPStats
+  TimePoint time, overshoot, busyTime;
+  size_t threads;
+  int hashfull;
+  bool helperBest;      // The best move was taken from a helper thread
+};
+
+void record(const SearchStats& stats);
+
+// serve() starts the HTTP server of the metrics on the given port of localhost,
+// or stops it if the port is 0. The metrics are served in the Prometheus text
+// format at /metrics.
+
+void serve(int port);
+
+} // namespace Stockfish::Metrics
+
+#endif // #ifndef METRICS_H_INCLUDED
@@ -27,6 +27,7 @@
 #endif
 
 #include <windows.h>
+#include <psapi.h>
 // The needed Windows API for processor groups could be missed from old Windows
 // versions, so instead of calling them directly (forcing the linker to resolve
 // the calls at compile time), try to load them at runtime. To do this we need
@@ -38,6 +39,7 @@ typedef bool(*fun2_t)(USHORT, PGROUP_AFFINITY);
 typedef bool(*fun3_t)(HANDLE, CONST GROUP_AFFINITY*, PGROUP_AFFINITY);
 typedef bool(*fun4_t)(USHORT, PGROUP_AFFINITY, USHORT, PUSHORT);
 typedef WORD(*fun5_t)();
+typedef BOOL(*fun6_t)(HANDLE, PVOID, DWORD);
 }
 #endif
 
@@ -49,8 +51,11 @@ typedef WORD(*fun5_t)();
 #include <cstdlib>
 
 #if defined(__linux__) && !defined(__ANDROID__)
+#include <sched.h>
 #include <stdlib.h>
 #include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
 #endif
 
 #if defined(__APPLE__) || defined(__ANDROID__) || defined(__OpenBSD__) || (defined(__GLIBCXX__) && !defined(_GLIBCXX_HAVE_ALIGNED_ALLOC) && !defined(_WIN32)) || defined(__e2k__)
@@ -367,6 +372,56 @@ void std_aligned_free(void* ptr) {
 #endif
 }
 
+// Explicit large page allocations are recorded, so that they can be released
+// with the matching system call and we can report the page size obtained.
+
+namespace {
+
+struct LargePagesBlock {
+  void* mem;
+  size_t size;
+  size_t pageSize;
+  bool mapped;
+};
+
+std::vector<LargePagesBlock> LargePagesBlocks;
+std::mutex LargePagesMutex;
+
+void add_large_pages_block(void* mem, size_t size, size_t pageSize, bool mapped) {
+
+  std::lock_guard<std::mutex> lk(LargePagesMutex);
+  LargePagesBlocks.push_back({ mem, size, pageSize, mapped });
+}
+
+bool remove_large_pages_block(void* mem, LargePagesBlock& block) {
+
+  std::lock_guard<std::mutex> lk(LargePagesMutex);
+
+  for (auto it = LargePagesBlocks.begin(); it != LargePagesBlocks.end(); ++it)
+      if (it->mem == mem)
+      {
+          block = *it;
+          LargePagesBlocks.erase(it);
+          return true;
+      }
+
+  return false;
+}
+
+bool find_large_pages_block(void* mem, LargePagesBlock& block) {
+
+  std::lock_guard<std::mutex> lk(LargePagesMutex);
+
+  for (const auto& b : LargePagesBlocks)
+      if (b.mem == mem)
+          return block = b, true;
+
+  return false;
+}
+
+} // namespace
+
+
 // aligned_large_pages_alloc() will return suitably aligned memory, if possible using large pages.
 
 #if defined(_WIN32)
@@ -417,15 +472,19 @@ static void* aligned_large_pages_alloc_windows([[maybe_unused]] size_t allocSize
 
   CloseHandle(hProcessToken);
 
+  if (mem)
+      add_large_pages_block(mem, allocSize, largePageSize, false);
+
   return mem;
 
   #endif
 }
 
-void* aligned_large_pages_alloc(size_t allocSize) {
+void* aligned_large_pages_alloc(size_t allocSize, LargePageMode mode) {
 
-  // Try to allocate large pages
-  void* mem = aligned_large_pages_alloc_windows(allocSize);
+  // Try to allocate large pages. Windows only offers the minimum large page
+  // size through VirtualAlloc(), so LP_2MB and LP_1GB both request that one.
+  void* mem = mode != LP_OFF ? aligned_large_pages_alloc_windows(allocSize) : nullptr;
 
   // Fall back to regular, page aligned, allocation if necessary
   if (!mem)
@@ -436,7 +495,50 @@ void* aligned_large_pages_alloc(size_t allocSize) {
 
 #else
 
-void* aligned_large_pages_alloc(size_t allocSize) {
+#if defined(__linux__) && defined(MAP_HUGETLB)
+
+// aligned_large_pages_alloc_hugetlb() maps anonymous memory from the explicit
+// huge page pool (see /proc/sys/vm/nr_hugepages). Unlike transparent huge pages
+// this either succeeds with the requested page size or fails immediately.
+
+static void* aligned_large_pages_alloc_hugetlb(size_t allocSize, size_t pageSize) {
+
+  int flags = MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB;
+
+#if defined(MAP_HUGE_SHIFT)
+  flags |= (pageSize == (size_t(1) << 30) ? 30 : 21) << MAP_HUGE_SHIFT;
+#else
+  if (pageSize != (size_t(1) << 21)) // Only the default huge page size is available
+      return nullptr;
+#endif
+
+  size_t size = ((allocSize + pageSize - 1) / pageSize) * pageSize;
+  void* mem = mmap(nullptr, size, PROT_READ | PROT_WRITE, flags, -1, 0);
+
+  if (mem == MAP_FAILED)
+      return nullptr;
+
+  add_large_pages_block(mem, size, pageSize, true);
+  return mem;
+}
+
+#endif
+
+void* aligned_large_pages_alloc(size_t allocSize, [[maybe_unused]] LargePageMode mode) {
+
+#if defined(__linux__) && defined(MAP_HUGETLB)
+  // Explicit huge pages, falling back from 1GB to 2MB to transparent huge pages
+  void* hugeMem = nullptr;
+
+  if (mode == LP_1GB)
+      hugeMem = aligned_large_pages_alloc_hugetlb(allocSize, size_t(1) << 30);
+
+  if (!hugeMem && (mode == LP_1GB || mode == LP_2MB))
+      hugeMem = aligned_large_pages_alloc_hugetlb(allocSize, size_t(1) << 21);
+
+  if (hugeMem)
+      return hugeMem;
+#endif
 
 #if defined(__linux__)
   constexpr size_t alignment = 2 * 1024 * 1024; // assumed 2MB page size
@@ -448,7 +550,15 @@ void* aligned_large_pages_alloc(size_t allocSize) {
   size_t size = ((allocSize + alignment - 1) / alignment) * alignment;
   void *mem = std_aligned_alloc(alignment, size);
 #if defined(MADV_HUGEPAGE)
-  madvise(mem, size, MADV_HUGEPAGE);
+  if (mem)
+  {
+      madvise(mem, size, mode != LP_OFF ? MADV_HUGEPAGE : MADV_NOHUGEPAGE);
+
+      // The chunk may be reused from memory already backed by pages of the other
+      // size, which the advice does not change. Drop them to have the memory
+      // faulted in again as advised.
+      madvise(mem, size, MADV_DONTNEED);
+  }
 #endif
   return mem;
 }
@@ -462,6 +572,9 @@ void* aligned_large_pages_alloc(size_t allocSize) {
 
 void aligned_large_pages_free(void* mem) {
 
+  LargePagesBlock block;
+  remove_large_pages_block(mem, block);
+
   if (mem && !VirtualFree(mem, 0, MEM_RELEASE))
   {
       DWORD err = GetLastError();
@@ -475,18 +588,237 @@ void aligned_large_pages_free(void* mem) {
 #else
 
 void aligned_large_pages_free(void *mem) {
+
+  LargePagesBlock block;
+
+  if (mem && remove_large_pages_block(mem, block) && block.mapped)
+  {
+#if defined(__linux__)
+      munmap(block.mem, block.size);
+#endif
+      return;
+  }
+
   std_aligned_free(mem);
 }
 
 #endif
 
 
+// large_pages_info() reports how the memory returned by aligned_large_pages_alloc()
+// is actually backed: pageSize is set to the largest page size in use and the
+// number of bytes backed by large pages is returned. Transparent huge pages are
+// only known once the memory has been touched, so call this after initializing it.
+
+size_t large_pages_info(void* mem, size_t size, size_t& pageSize) {
+
+  LargePagesBlock block;
+  pageSize = 4096;
+
+  if (!mem)
+      return 0;
+
+  if (find_large_pages_block(mem, block))
+      return pageSize = block.pageSize, std::min(size, block.size);
+
+#if defined(__linux__) && !defined(__ANDROID__)
+  // Sum the AnonHugePages of the mappings overlapping [mem, mem + size)
+  std::ifstream smaps("/proc/self/smaps");
+  std::string line;
+  uintptr_t start = reinterpret_cast<uintptr_t>(mem), end = start + size;
+  bool overlaps = false;
+  size_t hugeBytes = 0;
+
+  while (std::getline(smaps, line))
+  {
+      std::istringstream ls(line);
+      unsigned long long lo, hi;
+      char dash;
+
+      // Mapping headers look like "7f0c00000000-7f0c40000000 rw-p ..."
+      if (ls >> std::hex >> lo >> dash >> hi && dash == '-')
+          overlaps = lo < end && hi > start;
+
+      else if (overlaps && line.rfind("AnonHugePages:", 0) == 0)
+          hugeBytes += size_t(std::stoull(line.substr(14))) * 1024;
+  }
+
+  if (hugeBytes)
+      pageSize = 2 * 1024 * 1024;
+
+  return std::min(hugeBytes, size);
+#else
+  return 0;
+#endif
+}
+
+
+// memory_nodes() returns the number of bytes of [mem, mem + size) placed on
+// each NUMA node, indexed by node, or an empty vector if the OS does not tell.
+// Pages not yet touched have no node and are not counted.
+
+std::vector<size_t> memory_nodes(const void* mem, size_t size) {
+
+  constexpr size_t PageSize = 4096;
+
+  std::vector<size_t> nodes;
+  uintptr_t first = reinterpret_cast<uintptr_t>(mem) & ~uintptr_t(PageSize - 1);
+  size_t count = mem ? (reinterpret_cast<uintptr_t>(mem) + size - first + PageSize - 1) / PageSize : 0;
+
+#if defined(__linux__) && !defined(__ANDROID__) && defined(SYS_move_pages)
+  // move_pages() without target nodes only queries the node of each page
+  constexpr size_t Batch = 1024;
+  void* pages[Batch];
+  int status[Batch];
+
+  for (size_t i = 0; i < count; i += Batch)
+  {
+      size_t n = std::min(Batch, count - i);
+
+      for (size_t j = 0; j < n; ++j)
+          pages[j] = reinterpret_cast<void*>(first + (i + j) * PageSize);
+
+      if (syscall(SYS_move_pages, 0, n, pages, nullptr, status, 0) != 0)
+          return std::vector<size_t>();
+
+      for (size_t j = 0; j < n; ++j)
+          if (status[j] >= 0)
+          {
+              if (size_t(status[j]) >= nodes.size())
+                  nodes.resize(status[j] + 1);
+
+              nodes[status[j]] += PageSize;
+          }
+  }
+#elif defined(_WIN32)
+  HMODULE k32 = GetModuleHandle("Kernel32.dll");
+  auto fun6 = (fun6_t)(void(*)())GetProcAddress(k32, "K32QueryWorkingSetEx");
+
+  if (!fun6)
+      return nodes;
+
+  std::vector<PSAPI_WORKING_SET_EX_INFORMATION> info(count);
+
+  for (size_t i = 0; i < count; ++i)
+      info[i].VirtualAddress = reinterpret_cast<PVOID>(first + i * PageSize);
+
+  if (!fun6(GetCurrentProcess(), info.data(), DWORD(count * sizeof(info[0]))))
+      return std::vector<size_t>();
+
+  for (const auto& pi : info)
+      if (pi.VirtualAttributes.Valid)
+      {
+          if (pi.VirtualAttributes.Node >= nodes.size())
+              nodes.resize(pi.VirtualAttributes.Node + 1);
+
+          nodes[pi.VirtualAttributes.Node] += PageSize;
+      }
+#endif
+
+  return nodes;
+}
+
+
 namespace WinProcGroup {
 
 #ifndef _WIN32
 
+#if defined(__linux__) && !defined(__ANDROID__)
+
+// cpu_list() reads a list of CPUs or nodes in the sysfs format, like "0-15,32-47"
+
+std::vector<int> cpu_list(const std::string& path) {
+
+  std::ifstream file(path);
+  std::vector<int> list;
+  std::string range;
+
+  while (std::getline(file, range, ','))
+  {
+      std::istringstream rs(range);
+      int first, last;
+      char dash;
+
+      if (!(rs >> first))
+          break;
+
+      if (!(rs >> dash >> last) || dash != '-')
+          last = first;
+
+      for (int c = first; c <= last; ++c)
+          list.push_back(c);
+  }
+
+  return list;
+}
+
+// bindThisThread() sets the affinity of the current thread to the CPUs of one
+// NUMA node. As on Windows, the nodes are filled one after the other, and the
+// threads beyond the number of CPUs are left to the OS. Only the CPUs the process
+// may run on are counted, and nothing is done on hosts with a single node.
+
+void bindThisThread(size_t idx) {
+
+  // Use only local variables to be thread-safe. The allowed CPUs are those of
+  // the main thread, the calling thread may already be bound to a node.
+  cpu_set_t allowed;
+  std::vector<std::vector<int>> nodes;
+
+  if (sched_getaffinity(getpid(), sizeof(allowed), &allowed))
+      return;
+
+  for (int n : cpu_list("/sys/devices/system/node/online"))
+  {
+      std::vector<int> cpus;
+
+      for (int c : cpu_list("/sys/devices/system/node/node" + std::to_string(n) + "/cpulist"))
+          if (c < CPU_SETSIZE && CPU_ISSET(c, &allowed))
+              cpus.push_back(c);
+
+      if (!cpus.empty())
+          nodes.push_back(cpus);
+  }
+
+  if (nodes.size() < 2)
+      return;
+
+  for (const auto& cpus : nodes)
+  {
+      if (idx < cpus.size())
+      {
+          cpu_set_t mask;
+          CPU_ZERO(&mask);
+
+          for (int c : cpus)
+              CPU_SET(c, &mask);
+
+          sched_setaffinity(0, sizeof(mask), &mask);
+          return;
+      }
+
+      idx -= cpus.size();
+  }
+}
+
+#else
+
 void bindThisThread(size_t) {}
 
+#endif
+
+// numa_node() returns the NUMA node of the processor the calling thread runs
+// on, which after bindThisThread() is the node the thread is bound to.
+
+int numa_node() {
+
+#if defined(__linux__) && !defined(__ANDROID__) && defined(SYS_getcpu)
+  unsigned cpu, node;
+  if (syscall(SYS_getcpu, &cpu, &node, nullptr) == 0)
+      return int(node);
+#endif
+  return -1;
+}
+
 #else
 
 // best_node() retrieves logical processor information using Windows specific
@@ -600,6 +932,20 @@ void bindThisThread(size_t idx) {
   }
 }
 
+
+// numa_node() returns the NUMA node of the processor the calling thread runs
+// on, which after bindThisThread() is the node the thread is bound to.
+
+int numa_node() {
+
+  PROCESSOR_NUMBER proc;
+  USHORT node;
+
+  GetCurrentProcessorNumberEx(&proc);
+
+  return GetNumaProcessorNodeEx(&proc, &node) ? int(node) : -1;
+}
+
 #endif
 
 } // namespace WinProcGroup
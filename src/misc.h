@@ -21,6 +21,7 @@
 
 #include <cassert>
 #include <chrono>
+#include <cstring>
 #include <ostream>
 #include <string>
 #include <vector>
@@ -36,8 +37,16 @@ void prefetch(void* addr);
 void start_logger(const std::string& fname);
 void* std_aligned_alloc(size_t alignment, size_t size);
 void std_aligned_free(void* ptr);
-void* aligned_large_pages_alloc(size_t size); // memory aligned by page size, min alignment: 4096 bytes
+
+// Page sizes that aligned_large_pages_alloc() may try first. LP_AUTO relies on
+// transparent huge pages (Linux) or the OS default large page size (Windows),
+// explicit sizes use MAP_HUGETLB on Linux and fall back to smaller pages.
+enum LargePageMode { LP_AUTO, LP_OFF, LP_2MB, LP_1GB };
+
+void* aligned_large_pages_alloc(size_t size, LargePageMode mode = LP_AUTO); // memory aligned by page size, min alignment: 4096 bytes
 void aligned_large_pages_free(void* mem); // nop if mem == nullptr
+size_t large_pages_info(void* mem, size_t size, size_t& pageSize); // returns bytes backed by large pages
+std::vector<size_t> memory_nodes(const void* mem, size_t size); // bytes placed on each NUMA node
 
 void dbg_hit_on(bool b);
 void dbg_hit_on(bool c, bool b);
@@ -51,12 +60,17 @@ inline TimePoint now() {
         (std::chrono::steady_clock::now().time_since_epoch()).count();
 }
 
+// HashTable is stored inline and left uninitialized, so that its pages are
+// first touched by clear(). The threads owning one are allocated from large
+// pages and clear it themselves, see Thread::idle_loop().
+
 template<class Entry, int Size>
 struct HashTable {
   Entry* operator[](Key key) { return &table[(uint32_t)key & (Size - 1)]; }
+  void clear() { std::memset(table, 0, sizeof(table)); }
 
 private:
-  std::vector<Entry> table = std::vector<Entry>(Size); // Allocate on the heap
+  Entry table[Size];
 };
 
 
@@ -184,6 +198,7 @@ inline uint64_t mul_hi64(uint64_t a, uint64_t b) {
 
 namespace WinProcGroup {
   void bindThisThread(size_t idx);
+  int numa_node(); // NUMA node of the processor running the calling thread, -1 if unknown
 }
 
 namespace CommandLine {
@@ -28,6 +28,24 @@ namespace Stockfish {
 
     namespace {
 
+        // splat_moves() appends the moves to all the squares of 'to', in the same
+        // order as a pop_lsb() loop, from 'to - D' or from 'from' when D is 0.
+        template<Direction D>
+        ExtMove* splat_moves(ExtMove* moveList, Bitboard to, Square from = SQ_A1) {
+
+            while (to)
+            {
+                Square s = pop_lsb(to);
+
+                if constexpr (D != 0)
+                    *moveList++ = Move(s - D, s);
+                else
+                    *moveList++ = Move(from, s);
+            }
+
+            return moveList;
+        }
+
         template<GenType Type, Direction D, bool Enemy>
         ExtMove* make_promotions(ExtMove* moveList, [[maybe_unused]] Square to) {
 
@@ -85,17 +103,8 @@ namespace Stockfish {
                     b2 &= pawn_attacks_bb(Them, ksq) | shift<Up + Up>(dcCandidatePawns);
                 }
 
-                while (b1)
-                {
-                    Square to = pop_lsb(b1);
-                    *moveList++ = Move(to - Up, to);
-                }
-
-                while (b2)
-                {
-                    Square to = pop_lsb(b2);
-                    *moveList++ = Move(to - Up - Up, to);
-                }
+                moveList = splat_moves<Up>(moveList, b1);
+                moveList = splat_moves<Up + Up>(moveList, b2);
             }
 
             // Promotions and underpromotions
@@ -120,18 +129,10 @@ namespace Stockfish {
             if constexpr (Type == CAPTURES || Type == EVASIONS || Type == NON_EVASIONS)
             {
                 Bitboard b = shift<UpRight>(pawnsNotOn7) & enemies;
-                while (b)
-                {
-                    Square to = pop_lsb(b);
-                    *moveList++ = Move(to - UpRight, to);
-                }
+                moveList = splat_moves<UpRight>(moveList, b);
 
                 b = shift<UpLeft>(pawnsNotOn7) & enemies;
-                while (b)
-                {
-                    Square to = pop_lsb(b);
-                    *moveList++ = Move(to - UpLeft, to);
-                }
+                moveList = splat_moves<UpLeft>(moveList, b);
 
                 if (pos.ep_square() != SQ_NONE)
                 {
@@ -170,8 +171,7 @@ namespace Stockfish {
                 if (Checks && (Pt == QUEEN || !(pos.blockers_for_king(~Us) & from)))
                     b &= pos.check_squares(Pt);
 
-                while (b)
-                    *moveList++ = Move(from, pop_lsb(b));
+                moveList = splat_moves<Direction(0)>(moveList, b, from);
             }
 
             return moveList;
@@ -208,8 +208,7 @@ namespace Stockfish {
                 if constexpr (Checks)
                     b &= ~attacks_bb<QUEEN>(pos.square<KING>(~Us));
 
-                while (b)
-                    *moveList++ = Move(ksq, pop_lsb(b));
+                moveList = splat_moves<Direction(0)>(moveList, b, ksq);
 
                 if ((Type == QUIETS || Type == NON_EVASIONS) && pos.can_castle(Us & ANY_CASTLING))
                     for (CastlingRights cr : {Us& KING_SIDE, Us& QUEEN_SIDE})
@@ -230,7 +230,7 @@ namespace Stockfish {
                     if (pos.attacks_from<KNIGHT>(to) & pos.check_squares(KNIGHT))
                         m.value += 6000;
 
-                    m.value += 2560 * popcount(PseudoAttacks[KNIGHT][to] & kingRing);
+                    m.value += 2560 * popcount(attacks_bb<KNIGHT>(to) & kingRing);
                 }
 
                 // Bonus for a queen eventually able to give check on the next move
@@ -239,7 +239,7 @@ namespace Stockfish {
                     if (pos.attacks_from<QUEEN>(to) & pos.check_squares(QUEEN))
                         m.value += 5000;
 
-                    m.value += 1280 * popcount(PseudoAttacks[QUEEN][to] & kingRing);
+                    m.value += 1280 * popcount(attacks_bb<QUEEN>(to) & kingRing);
                 }
 
                 // Bonus for a rook eventually able to give check on the next move
@@ -248,7 +248,7 @@ namespace Stockfish {
                     if (pos.attacks_from<ROOK>(to) & pos.check_squares(ROOK))
                         m.value += 4000;
 
-                    m.value += 960 * popcount(PseudoAttacks[ROOK][to] & kingRing);
+                    m.value += 960 * popcount(attacks_bb<ROOK>(to) & kingRing);
                 }
 
                 // Bonus for a bishop eventually able to give check on the next move
@@ -257,7 +257,7 @@ namespace Stockfish {
                     if (pos.attacks_from<BISHOP>(to) & pos.check_squares(BISHOP))
                         m.value += 3000;
 
-                    m.value += 640 * popcount(PseudoAttacks[BISHOP][to] & kingRing);
+                    m.value += 640 * popcount(attacks_bb<BISHOP>(to) & kingRing);
                 }
             }
         }
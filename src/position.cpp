@@ -80,7 +80,7 @@ namespace Stockfish {
         {
             StateInfo st;
             Position p;
-            p.set(pos.fen(), pos.is_chess960(), &st, pos.this_thread());
+            p.set(pos, &st, pos.this_thread());
             Tablebases::ProbeState s1, s2;
             Tablebases::WDLScore wdl = Tablebases::probe_wdl(p, &s1);
             int dtz = Tablebases::probe_dtz(p, &s2);
@@ -296,6 +296,25 @@ namespace Stockfish {
     }
 
 
+    // Position::set() overload copies the given position, binding the copy to
+    // the given StateInfo and thread. It is much cheaper than a round trip through
+    // fen() and keeps the whole current state, including the links to the previous
+    // states, which the copy shares read-only with the original for the repetition
+    // detection. So the original's states must outlive the copy.
+
+    Position& Position::set(const Position& pos, StateInfo* si, Thread* th) {
+
+        std::memcpy(static_cast<void*>(this), &pos, sizeof(Position));
+        *si = *pos.st;
+        st = si;
+        thisThread = th;
+
+        assert(pos_is_ok());
+
+        return *this;
+    }
+
+
     // Position::set_castling_right() is a helper function used to set castling
     // rights given the corresponding color and the rook starting square.
 
@@ -683,6 +702,169 @@ namespace Stockfish {
     }
 
 
+    // Position::has_legal_move() tests whether the side to move has any legal
+    // move, stopping at the first one found. The king moves are tried first, as
+    // they need no move generation and are legal in most positions.
+
+    bool Position::has_legal_move() const {
+
+        const Square ksq = square<KING>(sideToMove);
+
+        for (Bitboard b = attacks_bb<KING>(ksq) & ~pieces(sideToMove); b; )
+            if (!(attackers_to(pop_lsb(b), pieces() ^ ksq) & pieces(~sideToMove)))
+                return true;
+
+        // In double check only the king can move
+        if (more_than_one(checkers()))
+            return false;
+
+        ExtMove moves[MAX_MOVES];
+        ExtMove* end = checkers() ? generate<EVASIONS>(*this, moves)
+                                  : generate<NON_EVASIONS>(*this, moves);
+
+        for (ExtMove* m = moves; m != end; ++m)
+            if ((m->from_sq() != ksq || m->type_of() == CASTLING) && legal(*m))
+                return true;
+
+        return false;
+    }
+
+
+    // Position::mate_in_one() looks for a move that mates at once, without making
+    // any move: the candidates are the direct and discovered checks, found from
+    // check_squares() and blockers_for_king(), and each one is tested by mates().
+    // Only normal moves of pieces other than the king are tried, so promotions,
+    // castling, en passant and pawn double pushes are left to the search. Returns
+    // the mating move, or Move::none() if there is none among the candidates.
+
+    Move Position::mate_in_one() const {
+
+        if (checkers())
+            return Move::none();
+
+        const Color us = sideToMove, them = ~us;
+        const Square ksq = square<KING>(them);
+        const Bitboard discoverers = blockers_for_king(them) & pieces(us);
+
+        for (Bitboard b = pieces(us) & ~pieces(KING); b; )
+        {
+            const Square from = pop_lsb(b);
+            const PieceType pt = type_of(piece_on(from));
+            Bitboard targets;
+
+            if (pt == PAWN)
+            {
+                if (relative_rank(us, from) == RANK_7)
+                    continue;
+
+                targets =  (pawn_attacks_bb(us, from) & pieces(them))
+                         | (square_bb(from + pawn_push(us)) & ~pieces());
+            }
+            else
+                targets = attacks_bb(pt, from, pieces()) & ~pieces(us);
+
+            // Direct checks, and for a discovered check any move off the line
+            targets &= (discoverers & from) ? check_squares(pt) | ~line_bb(ksq, from)
+                                            : check_squares(pt);
+
+            while (targets)
+            {
+                const Move m(from, pop_lsb(targets));
+
+                if (legal(m) && mates(m))
+                    return m;
+            }
+        }
+
+        return Move::none();
+    }
+
+
+    // Position::mates() tests whether a legal, normal and checking move mates,
+    // working on the bitboards of the position after the move. The opponent king
+    // must have no safe square, and a single checker must be neither capturable
+    // nor blockable by a piece that is not pinned after the move.
+
+    bool Position::mates(Move m) const {
+
+        const Color us = sideToMove, them = ~us;
+        const Square from = m.from_sq(), to = m.to_sq(), ksq = square<KING>(them);
+        const PieceType moved = type_of(piece_on(from));
+
+        // Our pieces of the given types, and the occupancy, after the move
+        auto ours = [&](PieceType pt1, PieceType pt2) {
+            Bitboard b = pieces(us, pt1, pt2) & ~square_bb(from);
+            return moved == pt1 || moved == pt2 ? b | to : b;
+        };
+
+        const Bitboard occupied = (pieces() ^ from) | to;
+        const Bitboard theirs = pieces(them) & ~square_bb(to);
+
+        auto attackers = [&](Square s, Bitboard occ) {
+            return  (pawn_attacks_bb(them, s)    & ours(PAWN, PAWN))
+                  | (attacks_bb<KNIGHT>(s)       & ours(KNIGHT, KNIGHT))
+                  | (attacks_bb<BISHOP>(s, occ)  & ours(BISHOP, QUEEN))
+                  | (attacks_bb<  ROOK>(s, occ)  & ours(ROOK, QUEEN))
+                  | (attacks_bb<KING>(s)         & pieces(us, KING));
+        };
+
+        const Bitboard checkersAfter = attackers(ksq, occupied);
+
+        assert(checkersAfter);
+
+        // The king must have no safe square, sliders see through the king
+        for (Bitboard b = attacks_bb<KING>(ksq) & ~theirs; b; )
+            if (!attackers(pop_lsb(b), occupied ^ ksq))
+                return false;
+
+        if (more_than_one(checkersAfter))
+            return true;
+
+        // The pieces of the opponent pinned after the move
+        Bitboard pinned = 0;
+        Bitboard snipers =  (attacks_bb<  ROOK>(ksq) & ours(ROOK, QUEEN))
+                          | (attacks_bb<BISHOP>(ksq) & ours(BISHOP, QUEEN));
+
+        while (snipers)
+        {
+            const Square sniperSq = pop_lsb(snipers);
+            const Bitboard b = between_bb(ksq, sniperSq) & (occupied ^ sniperSq);
+
+            if (b && !more_than_one(b))
+                pinned |= b & theirs;
+        }
+
+        const Bitboard defenders = theirs & ~pinned & ~square_bb(ksq);
+        const Square checkSq = lsb(checkersAfter);
+
+        // No defender may capture the checker or step in between
+        for (Bitboard b = between_bb(ksq, checkSq); b; )
+        {
+            const Square s = pop_lsb(b);
+            Bitboard d =  (attacks_bb<KNIGHT>(s)           & pieces(KNIGHT))
+                        | (attacks_bb<BISHOP>(s, occupied) & pieces(BISHOP, QUEEN))
+                        | (attacks_bb<  ROOK>(s, occupied) & pieces(ROOK, QUEEN));
+
+            if (s == checkSq)
+                d |= pawn_attacks_bb(us, s) & pieces(PAWN);
+
+            else if (relative_rank(them, s) >= RANK_3)
+            {
+                const Square p = s - pawn_push(them);
+                d |= pieces(PAWN) & p;
+
+                if (relative_rank(them, s) == RANK_4 && !(occupied & p))
+                    d |= pieces(PAWN) & (p - pawn_push(them));
+            }
+
+            if (d & defenders)
+                return false;
+        }
+
+        return true;
+    }
+
+
     // Position::do_move() makes a move, and saves all information necessary
     // to a StateInfo object. The move is assumed to be legal. Pseudo-legal
     // moves should be filtered out before this function is called.
@@ -692,7 +874,7 @@ namespace Stockfish {
         assert(m.is_ok());
         assert(&newSt != st);
 
-        thisThread->nodes.fetch_add(1, std::memory_order_relaxed);
+        thisThread->count_node();
         Key k = st->key ^ Zobrist::side;
 
         // Copy some fields of the old state to our new StateInfo object except the
@@ -751,6 +933,10 @@ namespace Stockfish {
                 }
 
                 st->pawnKey ^= Zobrist::psq[captured][capsq];
+
+                // A pawn move prefetches the final pawn key further below
+                if (type_of(pc) != PAWN)
+                    prefetch(thisThread->pawnsTable[st->pawnKey]);
             }
             else
                 st->nonPawnMaterial[them] -= PieceValue[MG][captured];
@@ -818,13 +1004,15 @@ namespace Stockfish {
                 st->pawnKey ^= Zobrist::psq[pc][to];
                 st->materialKey ^= Zobrist::psq[promotion][pieceCount[promotion] - 1]
                     ^ Zobrist::psq[pc][pieceCount[pc]];
+                prefetch(thisThread->materialTable[st->materialKey]);
 
                 // Update material
                 st->nonPawnMaterial[us] += PieceValue[MG][promotion];
             }
 
-            // Update pawn hash key
+            // Update pawn hash key and prefetch access to pawnsTable
             st->pawnKey ^= Zobrist::psq[pc][from] ^ Zobrist::psq[pc][to];
+            prefetch(thisThread->pawnsTable[st->pawnKey]);
 
             // Reset rule 50 draw counter
             st->rule50 = 0;
@@ -1218,7 +1406,7 @@ namespace Stockfish {
 
     bool Position::is_draw(int ply) const {
 
-        if (st->rule50 > 99 && (!checkers() || MoveList<LEGAL>(*this).size()))
+        if (st->rule50 > 99 && (!checkers() || has_legal_move()))
             return true;
 
         // Return a draw score if a position repeats once earlier but strictly
@@ -85,6 +85,9 @@ namespace Stockfish {
         Position& set(const std::string& code, Color c, StateInfo* si);
         std::string fen() const;
 
+        // Copying without a FEN round trip
+        Position& set(const Position& pos, StateInfo* si, Thread* th);
+
         // Position representation
         Bitboard pieces(PieceType pt) const;
         Bitboard pieces(PieceType pt1, PieceType pt2) const;
@@ -122,10 +125,12 @@ namespace Stockfish {
 
         // Properties of moves
         bool legal(Move m) const;
+        bool has_legal_move() const;
         bool pseudo_legal(const Move m) const;
         bool capture(Move m) const;
         bool capture_stage(Move m) const;
         bool gives_check(Move m) const;
+        Move mate_in_one() const;
         Piece moved_piece(Move m) const;
         Piece captured_piece() const;
 
@@ -179,6 +184,7 @@ namespace Stockfish {
         void set_check_info(StateInfo* si) const;
 
         // Other helpers
+        bool mates(Move m) const;
         void move_piece(Square from, Square to);
         template<bool Do>
         void do_castling(Color us, Square from, Square& to, Square& rfrom, Square& rto);
@@ -292,12 +298,12 @@ namespace Stockfish {
 
         return  Pt == BISHOP || Pt == ROOK ? attacks_bb<Pt>(s, byTypeBB[ALL_PIECES])
             : Pt == QUEEN ? attacks_from<ROOK>(s) | attacks_from<BISHOP>(s)
-            : PseudoAttacks[Pt][s];
+            : attacks_bb<Pt>(s);
     }
 
     template<>
     inline Bitboard Position::attacks_from<PAWN>(Square s, Color c) const {
-        return PawnAttacks[c][s];
+        return pawn_attacks_bb(c, s);
     }
 
     inline Bitboard Position::attacks_from(PieceType pt, Square s) const {
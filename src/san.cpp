@@ -307,11 +307,11 @@ namespace Stockfish::SAN
 
 		if (pos.gives_check(move))
 		{
-			StateListPtr sp(new std::deque<StateInfo>(1));
+			StateInfo st, st2;
 			Position copy;
-			copy.set(pos.fen(), pos.side_to_move(), &sp->back(), nullptr);
-			copy.do_move(move, sp->emplace_back());
-			SAN << (MoveList<LEGAL>(copy).size() ? '+' : '#');
+			copy.set(pos, &st, pos.this_thread());
+			copy.do_move(move, st2);
+			SAN << (copy.has_legal_move() ? '+' : '#');
 		}
 
 		return SAN.str();
@@ -322,7 +322,7 @@ namespace Stockfish::SAN
 		std::ostringstream SAN;
 		StateListPtr sp(new std::deque<StateInfo>(1));
 		Position copy;
-		copy.set(pos.fen(), pos.is_chess960(), &sp->back(), nullptr);
+		copy.set(pos, &sp->back(), pos.this_thread());
 		for (const auto& move : rm.pv)
 		{
 			if (!move) break;
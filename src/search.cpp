@@ -27,6 +27,8 @@
 #include <sstream>
 
 #include "evaluate.h"
+#include "mateprover.h"
+#include "metrics.h"
 #include "misc.h"
 #include "movegen.h"
 #include "movepick.h"
@@ -212,8 +214,13 @@ namespace Stockfish {
         }
         else
         {
-            Threads.start_searching(); // start non-main threads
-            Thread::search();          // main thread start searching
+            rank_root_moves();
+
+            if (!prove_mate())
+            {
+                Threads.start_searching(); // start non-main threads
+                Thread::search();          // main thread start searching
+            }
         }
 
         // When we reach the maximum depth, we can arrive here without a raise of
@@ -228,7 +235,7 @@ namespace Stockfish {
 
        // Stop the threads if not already stopped (also raise the stop if
        // "ponderhit" just reset Threads.ponder).
-        Threads.stop = true;
+        Threads.request_stop();
 
         // Wait until all threads have finished
         Threads.wait_for_search_finished();
@@ -242,7 +249,16 @@ namespace Stockfish {
         Skill skill = Skill(int(Options["Skill Level"]), int(Options["UCI_LimitStrength"]) ? int(Options["UCI_Elo"]) : 0);
 
         if (int(Options["MultiPV"]) == 1 && !Limits.depth && !skill.enabled() && rootMoves[0].pv[0] != Move::none())
+        {
             bestThread = Threads.get_best_thread();
+            bestThreadPicks++;
+            helperPicks += bestThread != this;
+        }
+
+        record_metrics(bestThread);
+
+        if (Options["SMPStats"] && Threads.size() > 1)
+            smp_stats(bestThread);
 
         bestPreviousScore = bestThread->rootMoves[0].score;
         bestPreviousAverageScore = bestThread->rootMoves[0].averageScore;
@@ -250,8 +266,10 @@ namespace Stockfish {
         for (Thread* th : Threads)
             th->previousDepth = bestThread->completedDepth;
 
-        // Send again PV info if we have a new best thread
-        if (bestThread != this)
+        // Send again PV info if we have a new best thread. In deterministic mode
+        // always send it, with the final node count, unless there is no legal move.
+        if (   (bestThread != this || Threads.deterministic)
+            && bestThread->rootMoves[0].pv[0] != Move::none())
             sync_cout << UCI::pv(bestThread->rootPos, bestThread->completedDepth) << sync_endl;
 
         sync_cout << "bestmove " << UCI::move(bestThread->rootMoves[0].pv[0], rootPos.is_chess960());
@@ -263,6 +281,148 @@ namespace Stockfish {
     }
 
 
+    // MainThread::rank_root_moves() ranks the root moves with the tablebases. This
+    // is done here rather than in ThreadPool::start_thinking(), so that the UCI
+    // thread is not blocked meanwhile and the probes are spread over all the
+    // search threads. The ranks are then copied to the root moves of each thread.
+
+    void MainThread::rank_root_moves() {
+
+        TimePoint start = now();
+
+        Tablebases::rank_root_moves(rootPos, rootMoves);
+
+        if (!TB::RootInTB)
+            return;
+
+        for (Thread* th : Threads)
+            if (th != this)
+            {
+                for (RootMove& rm : th->rootMoves)
+                {
+                    const RootMove& ranked = *std::find(rootMoves.begin(), rootMoves.end(), rm.pv[0]);
+                    rm.tbRank = ranked.tbRank;
+                    rm.tbScore = ranked.tbScore;
+                }
+
+                std::stable_sort(th->rootMoves.begin(), th->rootMoves.end(),
+                    [](const RootMove& a, const RootMove& b) { return a.tbRank > b.tbRank; });
+            }
+
+        sync_cout << "info string Syzygy root probe " << rootMoves.size() << " moves in "
+                  << now() - start << " ms" << sync_endl;
+    }
+
+
+    // MainThread::prove_mate() tries first the checks-only mate prover on 'go mate'.
+    // It often proves the mate much faster than the alpha-beta search, which is
+    // used when the prover fails. The prover gives a single line, so it is not
+    // used with MultiPV, where the other lines would never be searched.
+
+    bool MainThread::prove_mate() {
+
+        std::vector<Move> pv;
+        int mateMoves =  Limits.mate > 0 && Options["MultiPV"] == 1
+                       ? MateProver::search(rootPos, rootMoves, Limits.mate, pv) : 0;
+
+        if (!mateMoves)
+            return false;
+
+        RootMove& rm = *std::find(rootMoves.begin(), rootMoves.end(), pv[0]);
+        rm.score = rm.uciScore = rm.previousScore = rm.averageScore = mate_in(2 * mateMoves - 1);
+        rm.scoreLowerbound = rm.scoreUpperbound = false;
+        rm.selDepth = int(pv.size());
+        rm.pv = pv;
+
+        std::stable_sort(rootMoves.begin(), rootMoves.end());
+        pvIdx = 0;
+        rootDepth = completedDepth = 2 * mateMoves - 1;
+
+        sync_cout << UCI::pv(rootPos, completedDepth) << sync_endl;
+
+        return true;
+    }
+
+
+    // MainThread::record_metrics() adds the finished search to the metrics served
+    // on MetricsPort. The overshoot is the time used beyond the movetime, or beyond
+    // the maximum time allowed by the time management.
+
+    void MainThread::record_metrics(const Thread* bestThread) {
+
+        Metrics::SearchStats stats = {};
+        TimePoint elapsed = now() - Limits.startTime;
+        TimePoint allotted = Limits.movetime ? Limits.movetime : Limits.use_time_management() ? Time.maximum() : 0;
+
+        for (Thread* th : Threads)
+        {
+            stats.ttProbes += th->ttProbes;
+            stats.ttHits += th->ttHits;
+            stats.busyTime += th == this ? elapsed : th->busyTime;
+
+            for (size_t w = 0; w < th->hitsFrom.size(); ++w)
+                stats.foreignHits += w != th->id() ? th->hitsFrom[w] : 0;
+        }
+
+        stats.nodes = Threads.nodes_searched();
+        stats.tbHits = Threads.tb_hits();
+        stats.time = elapsed;
+        stats.overshoot = allotted ? std::max(elapsed - allotted, TimePoint(0)) : 0;
+        stats.threads = Threads.size();
+        stats.hashfull = TT.hashfull();
+        stats.helperBest = bestThread != this;
+
+        Metrics::record(stats);
+    }
+
+
+    // MainThread::smp_stats() reports with SMPStats how the threads shared the
+    // work of the search: the nodes and completed depth of each thread, the share
+    // of its nodes that are duplicates, i.e. TT hits on entries created by another
+    // thread in this search, and how often its own entries were hit by the others.
+
+    void MainThread::smp_stats(const Thread* bestThread) {
+
+        std::vector<uint64_t> hitsByOthers(Threads.size());
+        uint64_t duplicates = 0;
+
+        auto percent = [](uint64_t a, uint64_t b) {
+            std::stringstream ss;
+            ss.setf(std::ios::fixed);
+            ss.precision(1);
+            ss << 100.0 * a / std::max(b, uint64_t(1)) << "%";
+            return ss.str();
+        };
+
+        for (Thread* th : Threads)
+            for (size_t w = 0; w < th->hitsFrom.size(); ++w)
+                if (w != th->id())
+                    hitsByOthers[w] += th->hitsFrom[w];
+
+        for (Thread* th : Threads)
+        {
+            uint64_t dup = 0;
+            for (size_t w = 0; w < th->hitsFrom.size(); ++w)
+                dup += w != th->id() ? th->hitsFrom[w] : 0;
+
+            duplicates += dup;
+
+            sync_cout << "info string smp thread " << th->id()
+                      << " nodes " << th->nodes
+                      << " depth " << th->completedDepth
+                      << " duplicates " << percent(dup, th->nodes)
+                      << " hitsbyothers " << hitsByOthers[th->id()]
+                      << (th == bestThread ? " best" : "") << sync_endl;
+        }
+
+        sync_cout << "info string smp threads " << Threads.size()
+                  << " nodes " << Threads.nodes_searched()
+                  << " duplicates " << percent(duplicates, Threads.nodes_searched())
+                  << " bestthread " << bestThread->id()
+                  << " helperpicks " << helperPicks << " of " << bestThreadPicks << sync_endl;
+    }
+
+
     // Thread::search() is the main iterative deepening loop. It calls search()
     // repeatedly with increasing depth until the allocated thinking time has been
     // consumed, the user stops the search, or the maximum search depth is reached.
@@ -278,10 +438,11 @@ namespace Stockfish {
         Value alpha, beta;
         Move  lastBestMove = Move::none();
         Depth lastBestMoveDepth = 0;
-        MainThread* mainThread = (this == Threads.main() ? Threads.main() : nullptr);
+        MainThread* mainThread = (this == Threads.main() && !nodesLimit ? Threads.main() : nullptr);
         double timeReduction = 1, totBestMoveChanges = 0;
         Color us = rootPos.side_to_move();
         int delta, iterIdx = 0;
+        TimePoint searchStart = now();
 
         std::memset(ss - 7, 0, 10 * sizeof(Stack));
         for (int i = 7; i > 0; i--)
@@ -324,11 +485,38 @@ namespace Stockfish {
 
         int searchAgainCounter = 0;
 
+        // Helper threads of a multithreaded mate search work on a single root move
+        // at a time, up to the depth given by ThreadPool::next_mate_move(), or until
+        // an iteration proves that the move loses.
+        const bool useMateQueue = this != Threads.main() && Threads.use_mate_queue();
+        Depth mateItemDepth = 0;
+
         // Iterative deepening loop until requested to stop or the target depth is reached
         while (++rootDepth < MAX_PLY
-            && !Threads.stop
+            && !search_stopped()
             && !(Limits.depth && mainThread && rootDepth > Limits.depth))
         {
+            const bool refuted = useMateQueue && completedDepth && rootMoves[0].score <= VALUE_TB_LOSS_IN_MAX_PLY;
+
+            if (useMateQueue && (rootDepth > mateItemDepth || refuted))
+            {
+                if (refuted)
+                    Threads.refute_mate_move(rootMoves[0].pv[0]);
+
+                if (!Threads.next_mate_move(rootMoves, mateItemDepth))
+                    break;
+
+                // Restart the iterative deepening on the new root move
+                mateItems++;
+                rootDepth = 1;
+                completedDepth = 0;
+                lastBestMove = Move::none();
+                lastBestMoveDepth = searchAgainCounter = 0;
+                bestValue = delta = alpha = -VALUE_INFINITE;
+                beta = VALUE_INFINITE;
+                multiPV = 1;
+            }
+
             // Age out PV variability metric
             if (mainThread)
                 totBestMoveChanges /= 2;
@@ -345,7 +533,7 @@ namespace Stockfish {
                 searchAgainCounter++;
 
             // MultiPV loop. We perform a full root search for each PV line
-            for (pvIdx = 0; pvIdx < multiPV && !Threads.stop; ++pvIdx)
+            for (pvIdx = 0; pvIdx < multiPV && !search_stopped(); ++pvIdx)
             {
                 if (pvIdx == pvLast)
                 {
@@ -397,7 +585,7 @@ namespace Stockfish {
                     // If search has been stopped, we break immediately. Sorting is
                     // safe because RootMoves is still valid, although it refers to
                     // the previous iteration.
-                    if (Threads.stop)
+                    if (search_stopped())
                         break;
 
                     // When failing high/low give some update (without cluttering
@@ -440,7 +628,7 @@ namespace Stockfish {
                     sync_cout << UCI::pv(rootPos, rootDepth) << sync_endl;
             }
 
-            if (!Threads.stop)
+            if (!search_stopped())
                 completedDepth = rootDepth;
 
             if (rootMoves[0].pv[0] != lastBestMove) {
@@ -448,13 +636,18 @@ namespace Stockfish {
                 lastBestMoveDepth = rootDepth;
             }
 
-            // Have we found a "mate in x"?
-            if (Limits.mate > 0 && bestValue >= VALUE_MATE_IN_MAX_PLY && VALUE_MATE - bestValue <= 2 * Limits.mate)
-                Threads.stop = true;
+            // Have we found a "mate in x" or a "mated in x"? With MultiPV, bestValue
+            // is the score of the last line, so look at the best one.
+            Value mateValue = rootMoves[0].score;
+            if (   (Limits.mate > 0 && mateValue >= VALUE_MATE_IN_MAX_PLY && VALUE_MATE - mateValue <=  2 * Limits.mate)
+                || (Limits.mate < 0 && mateValue >= VALUE_MATE_IN_MAX_PLY && VALUE_MATE - mateValue <= -2 * Limits.mate))
+            {
+                Threads.request_stop();
 
-            // Have we found a "mated in x"?
-            if (Limits.mate < 0 && bestValue >= VALUE_MATE_IN_MAX_PLY && VALUE_MATE - bestValue <= -2 * Limits.mate)
-                Threads.stop = true;
+                // In deterministic mode the other threads stop only at their next sync point
+                if (Threads.deterministic)
+                    break;
+            }
 
             if (!mainThread)
                 continue;
@@ -513,6 +706,12 @@ namespace Stockfish {
             iterIdx = (iterIdx + 1) & 3;
         }
 
+        // The main thread stops the other threads when reaching the target depth
+        if (Threads.deterministic)
+            Threads.leave_sync(this, mainThread && !(mainThread->ponder || Limits.infinite));
+
+        busyTime = now() - searchStart;
+
         if (!mainThread)
             return;
 
@@ -599,10 +798,17 @@ namespace Stockfish {
                 bestValue = -VALUE_INFINITE;
                 maxValue = VALUE_INFINITE;
 
-                // Check for the available remaining time
-                if (thisThread == Threads.main())
+                // Check for the available remaining time, or nodes of a thread searching alone
+                if (thisThread->nodesLimit)
+                    thisThread->limitReached = thisThread->nodes.load(std::memory_order_relaxed) >= thisThread->nodesLimit;
+
+                else if (thisThread == Threads.main())
                     static_cast<MainThread*>(thisThread)->check_time();
 
+                // In deterministic mode wait for the other threads at fixed node counts
+                if (Threads.deterministic && thisThread->nodes.load(std::memory_order_relaxed) >= thisThread->nextSyncNodes)
+                    Threads.sync(thisThread);
+
                 // Used to send selDepth info to GUI (selDepth counts from 1, ply from 0)
                 if (PvNode && thisThread->selDepth < ss->ply + 1)
                     thisThread->selDepth = ss->ply + 1;
@@ -610,7 +816,7 @@ namespace Stockfish {
                 if (!rootNode)
                 {
                     // Step 2. Check for aborted search and immediate draw
-                    if (Threads.stop.load(std::memory_order_relaxed) || pos.is_draw(ss->ply) || ss->ply >= MAX_PLY)
+                    if (thisThread->search_stopped() || pos.is_draw(ss->ply) || ss->ply >= MAX_PLY)
                         return (ss->ply >= MAX_PLY && !ss->inCheck) ? evaluate<SearchMate>(pos) : value_draw(pos.this_thread());
 
                     // Step 3. Mate distance pruning. Even if we mate at the next move our score
@@ -649,7 +855,9 @@ namespace Stockfish {
                 // position key in case of an excluded move.
                 excludedMove = ss->excludedMove;
                 posKey = excludedMove == Move::none() ? pos.key() : pos.key() ^ make_key(excludedMove.raw());
-                tte = TT.probe(posKey, ss->ttHit);
+                tte = TT.probe(posKey, ss->ttHit, thisThread);
+                thisThread->ttProbes++;
+                thisThread->ttHits += ss->ttHit;
                 ttValue = ss->ttHit ? value_from_tt<SearchMate>(tte->value(), ss->ply, pos.rule50_count()) : VALUE_NONE;
                 ttMove = rootNode ? thisThread->rootMoves[thisThread->pvIdx].pv[0] : ss->ttHit ? tte->move() : Move::none();
                 ttCapture = ttMove && pos.capture(ttMove);
@@ -711,7 +919,7 @@ namespace Stockfish {
 
                         if (err != TB::ProbeState::FAIL)
                         {
-                            thisThread->tbHits.fetch_add(1, std::memory_order_relaxed);
+                            thisThread->count_tb_hit();
 
                             int drawScore = TB::UseRule50 ? 1 : 0;
 
@@ -982,7 +1190,7 @@ namespace Stockfish {
 
                     ss->moveCount = ++moveCount;
 
-                    if (rootNode && thisThread == Threads.main() && Time.elapsed() > 3000)
+                    if (rootNode && thisThread == Threads.main() && !thisThread->nodesLimit && Time.elapsed() > 3000)
                         sync_cout << "info depth " << depth
                         << " currmove " << UCI::move(move, pos.is_chess960())
                         << " currmovenumber " << moveCount + thisThread->pvIdx << sync_endl;
@@ -1236,7 +1444,7 @@ namespace Stockfish {
                     // Finished searching the move. If a stop occurred, the return value of
                     // the search cannot be trusted, and we return immediately without
                     // updating best move, PV and TT.
-                    if (Threads.stop.load(std::memory_order_relaxed))
+                    if (thisThread->search_stopped())
                         return VALUE_ZERO;
 
                     if (rootNode)
@@ -1404,10 +1612,17 @@ namespace Stockfish {
                 bestValue = -VALUE_INFINITE;
                 maxValue = VALUE_INFINITE;
 
-                // Check for the available remaining time
-                if (thisThread == Threads.main())
+                // Check for the available remaining time, or nodes of a thread searching alone
+                if (thisThread->nodesLimit)
+                    thisThread->limitReached = thisThread->nodes.load(std::memory_order_relaxed) >= thisThread->nodesLimit;
+
+                else if (thisThread == Threads.main())
                     static_cast<MainThread*>(thisThread)->check_time();
 
+                // In deterministic mode wait for the other threads at fixed node counts
+                if (Threads.deterministic && thisThread->nodes.load(std::memory_order_relaxed) >= thisThread->nextSyncNodes)
+                    Threads.sync(thisThread);
+
                 // Used to send selDepth info to GUI (selDepth counts from 1, ply from 0)
                 if (PvNode && thisThread->selDepth < ss->ply + 1)
                     thisThread->selDepth = ss->ply + 1;
@@ -1416,13 +1631,13 @@ namespace Stockfish {
                 {
                     // Step 2. Check for aborted search and immediate draw
                     if (TB::UseRule50
-                        && pos.rule50_count() > 99 && (!ss->inCheck || MoveList<LEGAL>(pos).size()))
+                        && pos.rule50_count() > 99 && (!ss->inCheck || pos.has_legal_move()))
                         return value_draw(thisThread);
 
                     if (pos.is_draw(ss->ply))
                         return value_draw(thisThread);
 
-                    if (Threads.stop.load(std::memory_order_relaxed) || ss->ply >= MAX_PLY)
+                    if (thisThread->search_stopped() || ss->ply >= MAX_PLY)
                         return (ss->ply >= MAX_PLY && !ss->inCheck) ? evaluate<SearchMate>(pos) : VALUE_ZERO;
 
                     // Step 3. Mate distance pruning. Even if we mate at the next move our score
@@ -1447,7 +1662,9 @@ namespace Stockfish {
                 // Step 4. Transposition table lookup.
                 excludedMove = ss->excludedMove;
                 posKey = pos.key();
-                tte = TT.probe(posKey, ss->ttHit);
+                tte = TT.probe(posKey, ss->ttHit, thisThread);
+                thisThread->ttProbes++;
+                thisThread->ttHits += ss->ttHit;
                 ttValue = ss->ttHit ? value_from_tt<SearchMate>(tte->value(), ss->ply, pos.rule50_count()) : VALUE_NONE;
                 ttMove = rootNode ? thisThread->rootMoves[thisThread->pvIdx].pv[0] : ss->ttHit ? tte->move() : Move::none();
                 ttCapture = ttMove && pos.capture_stage(ttMove);
@@ -1508,7 +1725,7 @@ namespace Stockfish {
 
                         if (err != TB::ProbeState::FAIL)
                         {
-                            thisThread->tbHits.fetch_add(1, std::memory_order_relaxed);
+                            thisThread->count_tb_hit();
 
                             int drawScore = TB::UseRule50 ? 1 : 0;
 
@@ -1538,6 +1755,19 @@ namespace Stockfish {
                     }
                 }
 
+                // Near the leaves, a mate in one found by the bitboard detector is the
+                // best possible score, so it is exact and there is nothing to search.
+                // PV nodes are searched as usual to keep the lines of MultiPV complete.
+                if (!PvNode && !excludedMove && !ss->inCheck && depth <= 2)
+                    if (Move mateMove = pos.mate_in_one())
+                    {
+                        value = mate_in(ss->ply + 1);
+                        tte->save(posKey, value_to_tt(value, ss->ply), ss->ttPv, BOUND_EXACT,
+                            std::min(MAX_PLY - 1, depth + 6), mateMove, VALUE_NONE);
+
+                        return value;
+                    }
+
                 CapturePieceToHistory& captureHistory = thisThread->captureHistory;
 
                 // Step 6. Static evaluation of the position
@@ -1784,7 +2014,7 @@ namespace Stockfish {
 
                     ss->moveCount = ++moveCount;
 
-                    if (rootNode && thisThread == Threads.main() && Time.elapsed() > 3000)
+                    if (rootNode && thisThread == Threads.main() && !thisThread->nodesLimit && Time.elapsed() > 3000)
                         sync_cout << "info depth " << depth
                         << " currmove " << UCI::move(move, pos.is_chess960())
                         << " currmovenumber " << moveCount + thisThread->pvIdx << sync_endl;
@@ -2065,7 +2295,7 @@ namespace Stockfish {
                     // Finished searching the move. If a stop occurred, the return value of
                     // the search cannot be trusted, and we return immediately without
                     // updating best move, PV and TT.
-                    if (Threads.stop.load(std::memory_order_relaxed))
+                    if (thisThread->search_stopped())
                         return VALUE_ZERO;
 
                     if constexpr (rootNode)
@@ -2241,6 +2471,9 @@ namespace Stockfish {
                 ss->inCheck = pos.checkers();
                 moveCount = 0;
 
+                if (Threads.deterministic && thisThread->nodes.load(std::memory_order_relaxed) >= thisThread->nextSyncNodes)
+                    Threads.sync(thisThread);
+
                 // Used to send selDepth info to GUI (selDepth counts from 1, ply from 0)
                 if (PvNode && thisThread->selDepth < ss->ply + 1)
                     thisThread->selDepth = ss->ply + 1;
@@ -2258,7 +2491,9 @@ namespace Stockfish {
 
                 // Step 3. Transposition table lookup
                 posKey = pos.key();
-                tte = TT.probe(posKey, ss->ttHit);
+                tte = TT.probe(posKey, ss->ttHit, thisThread);
+                thisThread->ttProbes++;
+                thisThread->ttHits += ss->ttHit;
                 ttValue = ss->ttHit ? value_from_tt<SearchMate>(tte->value(), ss->ply, pos.rule50_count()) : VALUE_NONE;
                 ttMove = ss->ttHit ? tte->move() : Move::none();
                 pvHit = ss->ttHit && tte->is_pv();
@@ -2459,8 +2694,11 @@ namespace Stockfish {
                 ss->inCheck = pos.checkers();
                 moveCount = 0;
 
+                if (Threads.deterministic && thisThread->nodes.load(std::memory_order_relaxed) >= thisThread->nextSyncNodes)
+                    Threads.sync(thisThread);
+
                 // Step 2. Check for an immediate draw or maximum ply reached
-                if (TB::UseRule50 && pos.rule50_count() > 99 && (!ss->inCheck || MoveList<LEGAL>(pos).size()))
+                if (TB::UseRule50 && pos.rule50_count() > 99 && (!ss->inCheck || pos.has_legal_move()))
                     return value_draw(thisThread);
 
                 if (pos.is_draw(ss->ply))
@@ -2481,7 +2719,9 @@ namespace Stockfish {
 
                 // Step 3. Transposition table lookup
                 posKey = pos.key();
-                tte = TT.probe(posKey, ss->ttHit);
+                tte = TT.probe(posKey, ss->ttHit, thisThread);
+                thisThread->ttProbes++;
+                thisThread->ttHits += ss->ttHit;
                 ttValue = ss->ttHit ? value_from_tt<SearchMate>(tte->value(), ss->ply, pos.rule50_count()) : VALUE_NONE;
                 ttMove = ss->ttHit ? tte->move() : Move::none();
                 pvHit = ss->ttHit && tte->is_pv();
@@ -2493,6 +2733,20 @@ namespace Stockfish {
                     && (tte->bound() & (ttValue >= beta ? BOUND_LOWER : BOUND_UPPER)))
                     return ttValue;
 
+                // A mate in one found by the bitboard detector is exact
+                if (!ss->inCheck)
+                    if (Move mateMove = pos.mate_in_one())
+                    {
+                        value = mate_in(ss->ply + 1);
+                        tte->save(posKey, value_to_tt(value, ss->ply), pvHit, BOUND_EXACT,
+                            ttDepth, mateMove, VALUE_NONE);
+
+                        if constexpr (PvNode)
+                            ss->pv[0] = mateMove, ss->pv[1] = Move::none();
+
+                        return value;
+                    }
+
                 // Step 4. Static evaluation of the position
                 if (ss->inCheck)
                     bestValue = futilityBase = -VALUE_INFINITE;
@@ -2857,7 +3111,7 @@ namespace Stockfish {
 
         if ((Limits.use_time_management() && (elapsed > Time.maximum() - 10 || stopOnPonderhit))
             || (Limits.movetime && elapsed >= Limits.movetime)
-            || (Limits.nodes && Threads.nodes_searched() >= (uint64_t)Limits.nodes))
+            || (Limits.nodes && !Threads.deterministic && Threads.nodes_searched() >= (uint64_t)Limits.nodes))
             Threads.stop = true;
     }
 
@@ -2950,13 +3204,15 @@ namespace Stockfish {
         return pv.size() > 1;
     }
 
-    void Tablebases::rank_root_moves(Position& pos, Search::RootMoves& rootMoves) {
+    // Tablebases::set_probe_limits() sets up the tablebase probes of the search
+    // from the Syzygy options, before the root moves are ranked, if at all.
+
+    void Tablebases::set_probe_limits() {
 
         RootInTB = false;
         UseRule50 = bool(Options["Syzygy50MoveRule"]);
         ProbeDepth = int(Options["SyzygyProbeDepth"]);
         Cardinality = int(Options["SyzygyProbeLimit"]);
-        bool dtz_available = true;
 
         // Tables with fewer pieces than SyzygyProbeLimit are searched with
         // ProbeDepth == DEPTH_ZERO
@@ -2965,6 +3221,12 @@ namespace Stockfish {
             Cardinality = MaxCardinality;
             ProbeDepth = 0;
         }
+    }
+
+    void Tablebases::rank_root_moves(Position& pos, Search::RootMoves& rootMoves) {
+
+        set_probe_limits();
+        bool dtz_available = true;
 
         if (Cardinality >= popcount(pos.pieces()) && !pos.can_castle(ANY_CASTLING))
         {
@@ -29,9 +29,11 @@
 #include <mutex>
 
 #include "../bitboard.h"
+#include "../misc.h"
 #include "../movegen.h"
 #include "../position.h"
 #include "../search.h"
+#include "../thread.h"
 #include "../types.h"
 #include "../uci.h"
 
@@ -60,6 +62,7 @@ namespace Stockfish {
 
         constexpr int TBPIECES = 7; // Max number of supported pieces
         constexpr int MAX_DTZ = 1 << 18; // Max DTZ supported, large enough to deal with the syzygy TB limit.
+        constexpr int LenIdxBits = 8; // Bits looked up at once to decode a Huffman symbol length
 
         enum { BigEndian, LittleEndian };
         enum TBType { WDL, DTZ }; // Used as template parameter
@@ -81,6 +84,11 @@ namespace Stockfish {
         int LeadPawnIdx[6][SQUARE_NB]; // [leadPawnsCnt][SQUARE_NB]
         int LeadPawnsSize[6][4];       // [leadPawnsCnt][FILE_A..FILE_D]
 
+        // Tables read into RAM at init: all up to PreloadPieces pieces and the named ones
+        std::string PreloadSpec;
+        int PreloadPieces;
+        std::vector<std::string> PreloadNames;
+
         // Comparison function to sort leading pawns in ascending MapPawns[] order
         bool pawns_comp(Square i, Square j) { return MapPawns[i] < MapPawns[j]; }
         int off_A1H8(Square sq) { return int(rank_of(sq)) - file_of(sq); }
@@ -270,19 +278,60 @@ namespace Stockfish {
                     exit(EXIT_FAILURE);
                 }
 #endif
-                uint8_t* data = (uint8_t*)*baseAddress;
+                if (!has_magic((uint8_t*)*baseAddress, type))
+                {
+                    unmap(*baseAddress, *mapping);
+                    return *baseAddress = nullptr, nullptr;
+                }
 
-                constexpr uint8_t Magics[][4] = { { 0xD7, 0x66, 0x0C, 0xA5 },
-                                                  { 0x71, 0xE8, 0x23, 0x5D } };
+                return (uint8_t*)*baseAddress + 4; // Skip Magics's header
+            }
+
+            // Read the whole file into anonymous memory, using large pages if possible,
+            // so that probing does not depend on the OS page cache. File should be
+            // already open and will be closed after reading.
+            uint8_t* read(void** baseAddress, uint64_t* size, TBType type, LargePageMode mode) {
+
+                assert(is_open());
+
+                close(); // Need to re-open in binary mode
+
+                std::ifstream file(fname, std::ios::binary | std::ios::ate);
+                *size = uint64_t(file.tellg());
 
-                if (memcmp(data, Magics[type == WDL], 4))
+                if (*size % 64 != 16)
                 {
-                    std::cerr << "Corrupted table in file " << fname << std::endl;
-                    unmap(*baseAddress, *mapping);
+                    std::cerr << "Corrupt tablebase file " << fname << std::endl;
+                    exit(EXIT_FAILURE);
+                }
+
+                *baseAddress = aligned_large_pages_alloc(*size, mode);
+
+                if (!*baseAddress || !file.seekg(0).read((char*)*baseAddress, std::streamsize(*size)))
+                {
+                    std::cerr << "Could not read " << fname << std::endl;
+                    exit(EXIT_FAILURE);
+                }
+
+                if (!has_magic((uint8_t*)*baseAddress, type))
+                {
+                    aligned_large_pages_free(*baseAddress);
                     return *baseAddress = nullptr, nullptr;
                 }
 
-                return data + 4; // Skip Magics's header
+                return (uint8_t*)*baseAddress + 4; // Skip Magics's header
+            }
+
+            bool has_magic(const uint8_t* data, TBType type) const {
+
+                constexpr uint8_t Magics[][4] = { { 0xD7, 0x66, 0x0C, 0xA5 },
+                                                  { 0x71, 0xE8, 0x23, 0x5D } };
+
+                if (!memcmp(data, Magics[type == WDL], 4))
+                    return true;
+
+                std::cerr << "Corrupted table in file " << fname << std::endl;
+                return false;
             }
 
             static void unmap(void* baseAddress, uint64_t mapping) {
@@ -317,6 +366,7 @@ namespace Stockfish {
             uint8_t* data;                 // Start of Huffman compressed data
             std::vector<uint64_t> base64;  // base64[l - min_sym_len] is the 64bit-padded lowest symbol of length l
             std::vector<uint8_t> symlen;   // Number of values (-1) represented by a given Huffman symbol: 1..256
+            std::vector<uint8_t> lenIdx;   // lenIdx[b] is the shortest symbol length (- min_sym_len) starting with bits b
             Piece pieces[TBPIECES];        // Position pieces: the order of pieces defines the groups
             uint64_t groupIdx[TBPIECES + 1]; // Start index used for the encoding of the group's pieces
             int groupLen[TBPIECES + 1];      // Number of pieces in a given group: KRKN -> (3, 1)
@@ -334,6 +384,7 @@ namespace Stockfish {
             static constexpr int Sides = Type == WDL ? 2 : 1;
 
             std::atomic_bool ready;
+            bool inRam;      // Preloaded, baseAddress is not a file mapping
             void* baseAddress;
             uint8_t* map;
             uint64_t mapping;
@@ -349,12 +400,14 @@ namespace Stockfish {
                 return &items[stm % Sides][hasPawns ? f : 0];
             }
 
-            TBTable() : ready(false), baseAddress(nullptr) {}
+            TBTable() : ready(false), inRam(false), baseAddress(nullptr) {}
             explicit TBTable(const std::string& code);
             explicit TBTable(const TBTable<WDL>& wdl);
 
             ~TBTable() {
-                if (baseAddress)
+                if (inRam)
+                    aligned_large_pages_free(baseAddress);
+                else if (baseAddress)
                     TBFile::unmap(baseAddress, mapping);
             }
         };
@@ -463,9 +516,29 @@ namespace Stockfish {
                 memset(hashTable, 0, sizeof(hashTable));
                 wdlTable.clear();
                 dtzTable.clear();
+                preloadList.clear();
+            }
+
+            // Unmap the files mapped at first access, they will be mapped again
+            // when needed. The preloaded tables stay in RAM.
+            void unmap_files() {
+                auto unmap = [](auto& e) {
+                    if (e.baseAddress && !e.inRam)
+                    {
+                        TBFile::unmap(e.baseAddress, e.mapping);
+                        e.baseAddress = nullptr;
+                        e.ready = false;
+                    }
+                };
+
+                std::for_each(wdlTable.begin(), wdlTable.end(), unmap);
+                std::for_each(dtzTable.begin(), dtzTable.end(), unmap);
             }
             size_t size() const { return wdlTable.size(); }
             void add(const std::vector<PieceType>& pieces);
+
+            // Tables selected by the "SyzygyPreload" option, by file name without extension
+            std::vector<std::pair<std::string, Entry>> preloadList;
         };
 
         TBTables TBTables;
@@ -494,6 +567,10 @@ namespace Stockfish {
             // Insert into the hash keys for both colors: KRvK with KR white and black
             insert(wdlTable.back().key, &wdlTable.back(), &dtzTable.back());
             insert(wdlTable.back().key2, &wdlTable.back(), &dtzTable.back());
+
+            if (   int(pieces.size()) <= PreloadPieces
+                || std::find(PreloadNames.begin(), PreloadNames.end(), code) != PreloadNames.end())
+                preloadList.emplace_back(code, Entry{ wdlTable.back().key, &wdlTable.back(), &dtzTable.back() });
         }
 
         // TB tables are compressed with canonical Huffman code. The compressed data is divided into
@@ -568,7 +645,10 @@ namespace Stockfish {
 
             while (true)
             {
-                int len = 0; // This is the symbol length - d->min_sym_len
+                // This is the symbol length - d->min_sym_len. The lookup on the next
+                // LenIdxBits bits gives the exact length of all the symbols that are
+                // not longer than that, and a lower bound for the others.
+                int len = d->lenIdx[buf64 >> (64 - LenIdxBits)];
 
                 // Now get the symbol length. For any symbol s64 of length l right-padded
                 // to 64 bits we know that d->base64[l-1] >= s64 >= d->base64[l] so we
@@ -1009,6 +1089,21 @@ namespace Stockfish {
             for (size_t i = 0; i < d->base64.size(); ++i)
                 d->base64[i] <<= 64 - i - d->minSymLen; // Right-padding to 64 bits
 
+            // The symbol length is a decreasing function of s64, so for all the s64
+            // starting with the bits b, the length of the biggest one is the shortest.
+            d->lenIdx.resize(1 << LenIdxBits);
+
+            for (size_t b = 0; b < d->lenIdx.size(); ++b)
+            {
+                uint64_t s64 = ((b + 1) << (64 - LenIdxBits)) - 1;
+                uint8_t len = 0;
+
+                while (s64 < d->base64[len])
+                    ++len;
+
+                d->lenIdx[b] = len;
+            }
+
             data += d->base64.size() * sizeof(Sym);
             d->symlen.resize(number<uint16_t, LittleEndian>(data)); data += sizeof(uint16_t);
             d->btree = (LR*)data;
@@ -1160,6 +1255,32 @@ namespace Stockfish {
             return e.baseAddress;
         }
 
+        // preload() reads the whole table file into RAM at init time, instead of
+        // mapping it at first access. It returns the size of the file, if found,
+        // and adds to largePages the bytes that are backed by large pages.
+        template<TBType Type>
+        uint64_t preload(TBTable<Type>& e, const std::string& fname, LargePageMode mode, uint64_t& largePages) {
+
+            TBFile file(fname);
+            uint64_t size = 0;
+
+            if (!file.is_open())
+                return 0;
+
+            uint8_t* data = file.read(&e.baseAddress, &size, Type, mode);
+
+            if (data)
+            {
+                size_t pageSize;
+                e.inRam = true;
+                largePages += large_pages_info(e.baseAddress, size, pageSize);
+                set(e, data);
+            }
+
+            e.ready.store(true, std::memory_order_release);
+            return data ? size : 0;
+        }
+
         template<TBType Type, typename Ret = typename TBTable<Type>::Ret>
         Ret probe_table(const Position& pos, ProbeState* result, WDLScore wdl = WDLDraw) {
 
@@ -1249,6 +1370,35 @@ namespace Stockfish {
             return *result = OK, value;
         }
 
+        // probe_root_moves() calls probe(p, rm) for each root move rm, where p is
+        // the root position. When called on the root position of the main thread,
+        // the moves are spread over the idle search threads, each one probing from
+        // its own copy of the root position, so that the many cold DTZ table reads
+        // of an endgame root are done in parallel. Returns false if a probe failed.
+        template<typename Probe>
+        bool probe_root_moves(Position& pos, Search::RootMoves& rootMoves, Probe probe) {
+
+            const size_t threadCount = &pos == &Threads.main()->rootPos
+                                     ? std::min(Threads.size(), rootMoves.size()) : 1;
+            std::atomic<bool> success(true);
+
+            auto job = [&](Position& p, size_t idx) {
+                for (size_t i = idx; i < rootMoves.size() && success; i += threadCount)
+                    if (!probe(p, rootMoves[i]))
+                        success = false;
+            };
+
+            for (size_t idx = 1; idx < threadCount; ++idx)
+                Threads[idx]->run_custom_job([&, idx]() { job(Threads[idx]->rootPos, idx); });
+
+            job(pos, 0);
+
+            for (size_t idx = 1; idx < threadCount; ++idx)
+                Threads[idx]->wait_for_search_finished();
+
+            return success;
+        }
+
     } // namespace
 
 
@@ -1257,10 +1407,39 @@ namespace Stockfish {
     // safe, nor it needs to be.
     void Tablebases::init(const std::string& paths) {
 
+        std::string spec = Options["SyzygyPreload"];
+
+        // At a new game with the same settings keep the preloaded tables, which
+        // could take a long time to read again, and unmap only the other files.
+        if (   paths == TBFile::Paths
+            && spec == PreloadSpec
+            && TBTables.preloadList.size())
+        {
+            TBTables.unmap_files();
+            return;
+        }
+
         TBTables.clear();
         MaxCardinality = 0;
         TBFile::Paths = paths;
 
+        // "SyzygyPreload" is a list of table names like "KQvKR" and/or a number of
+        // pieces, separated by spaces, commas or semicolons: "5" preloads all the
+        // tables up to 5 pieces.
+        PreloadSpec = spec;
+        PreloadPieces = 0;
+        PreloadNames.clear();
+
+        std::replace_if(spec.begin(), spec.end(), [](char c) { return c == ',' || c == ';'; }, ' ');
+        std::istringstream ss(spec);
+        std::string token;
+
+        while (ss >> token)
+            if (token.find_first_not_of("0123456789") == std::string::npos)
+                PreloadPieces = std::stoi(token);
+            else if (token != "<empty>")
+                PreloadNames.push_back(token);
+
         if (paths.empty() || paths == "<empty>")
             return;
 
@@ -1294,7 +1473,7 @@ namespace Stockfish {
                 if (MapA1D1D4[s1] == idx && (idx || s1 == SQ_B1)) // SQ_B1 is mapped to 0
                 {
                     for (Square s2 = SQ_A1; s2 <= SQ_H8; ++s2)
-                        if ((PseudoAttacks[KING][s1] | s1) & s2)
+                        if ((attacks_bb<KING>(s1) | s1) & s2)
                             continue; // Illegal position
 
                         else if (!off_A1H8(s1) && off_A1H8(s2) > 0)
@@ -1396,6 +1575,26 @@ namespace Stockfish {
         }
 
         sync_cout << "info string Found " << TBTables.size() << " tablebases" << sync_endl;
+
+        if (TBTables.preloadList.empty())
+            return;
+
+        LargePageMode mode =  Options["Large Pages"] == "Off" ? LP_OFF
+                            : Options["Large Pages"] == "2MB" ? LP_2MB
+                            : Options["Large Pages"] == "1GB" ? LP_1GB : LP_AUTO;
+
+        TimePoint start = now();
+        uint64_t bytes = 0, largePages = 0;
+
+        for (auto& [name, entry] : TBTables.preloadList)
+        {
+            bytes += preload(*entry.wdl, name + ".rtbw", mode, largePages);
+            bytes += preload(*entry.dtz, name + ".rtbz", mode, largePages);
+        }
+
+        sync_cout << "info string Preloaded " << TBTables.preloadList.size() << " tablebases, "
+                  << bytes / (1024 * 1024) << " MB in RAM (" << largePages / (1024 * 1024)
+                  << " MB on large pages) in " << now() - start << " ms" << sync_endl;
     }
 
     // Probe the WDL table for a particular position.
@@ -1478,7 +1677,7 @@ namespace Stockfish {
                 : -probe_dtz(pos, result);
 
             // If the move mates, force minDTZ to 1
-            if (dtz == 1 && pos.checkers() && MoveList<LEGAL>(pos).size() == 0)
+            if (dtz == 1 && pos.checkers() && !pos.has_legal_move())
                 minDTZ = 1;
 
             // Convert result from 1-ply search. Zeroing moves are already accounted
@@ -1506,30 +1705,31 @@ namespace Stockfish {
     // A return value false indicates that not all probes were successful.
     bool Tablebases::root_probe(Position& pos, Search::RootMoves& rootMoves) {
 
-        ProbeState result;
-        StateInfo st;
-
         // Obtain 50-move counter for the root position
         int cnt50 = pos.rule50_count();
 
         // Check whether a position was repeated since the last zeroing move.
         bool rep = pos.has_repeated();
 
-        int dtz, bound = Options["Syzygy50MoveRule"] ? (MAX_DTZ - 100) : 1;
+        int bound = Options["Syzygy50MoveRule"] ? (MAX_DTZ - 100) : 1;
 
         // Probe and rank each move
-        for (auto& m : rootMoves)
-        {
-            pos.do_move(m.pv[0], st);
+        return probe_root_moves(pos, rootMoves, [&](Position& p, Search::RootMove& m) {
+
+            ProbeState result = OK;
+            StateInfo st;
+            int dtz;
+
+            p.do_move(m.pv[0], st);
 
             // Calculate dtz for the current move counting from the root position
-            if (pos.rule50_count() == 0)
+            if (p.rule50_count() == 0)
             {
                 // In case of a zeroing move, dtz is one of -101/-1/0/1/101
-                WDLScore wdl = -probe_wdl(pos, &result);
+                WDLScore wdl = -probe_wdl(p, &result);
                 dtz = dtz_before_zeroing(wdl);
             }
-            else if (pos.is_draw(1))
+            else if (p.is_draw(1))
             {
                 // In case a root move leads to a draw by repetition or
                 // 50-move rule, we set dtz to zero. Note: since we are
@@ -1540,18 +1740,18 @@ namespace Stockfish {
             else
             {
                 // Otherwise, take dtz for the new position and correct by 1 ply
-                dtz = -probe_dtz(pos, &result);
+                dtz = -probe_dtz(p, &result);
                 dtz = dtz > 0 ? dtz + 1
                     : dtz < 0 ? dtz - 1 : dtz;
             }
 
             // Make sure that a mating move is assigned a dtz value of 1
-            if (pos.checkers()
+            if (p.checkers()
                 && dtz == 2
-                && MoveList<LEGAL>(pos).size() == 0)
+                && !p.has_legal_move())
                 dtz = 1;
 
-            pos.undo_move(m.pv[0]);
+            p.undo_move(m.pv[0]);
 
             if (result == FAIL)
                 return false;
@@ -1571,9 +1771,9 @@ namespace Stockfish {
                 : r == 0 ? VALUE_DRAW
                 : r > -bound ? Value((std::min(-3, r + (MAX_DTZ - 200)) * int(PawnValueEg)) / 200)
                 : -VALUE_MATE + MAX_PLY + 1;
-        }
 
-        return true;
+            return true;
+        });
     }
 
 
@@ -1585,23 +1785,23 @@ namespace Stockfish {
 
         static const int WDL_to_rank[] = { -MAX_DTZ, -MAX_DTZ + 101, 0, MAX_DTZ - 101, MAX_DTZ };
 
-        ProbeState result;
-        StateInfo st;
-        WDLScore wdl;
-
         bool rule50 = Options["Syzygy50MoveRule"];
 
         // Probe and rank each move
-        for (auto& m : rootMoves)
-        {
-            pos.do_move(m.pv[0], st);
+        return probe_root_moves(pos, rootMoves, [&](Position& p, Search::RootMove& m) {
+
+            ProbeState result = OK;
+            StateInfo st;
+            WDLScore wdl;
+
+            p.do_move(m.pv[0], st);
 
-            if (pos.is_draw(1))
+            if (p.is_draw(1))
                 wdl = WDLDraw;
             else
-                wdl = -probe_wdl(pos, &result);
+                wdl = -probe_wdl(p, &result);
 
-            pos.undo_move(m.pv[0]);
+            p.undo_move(m.pv[0]);
 
             if (result == FAIL)
                 return false;
@@ -1612,9 +1812,9 @@ namespace Stockfish {
                 wdl = wdl > WDLDraw ? WDLWin
                 : wdl < WDLDraw ? WDLLoss : WDLDraw;
             m.tbScore = WDL_to_value[wdl + 2];
-        }
 
-        return true;
+            return true;
+        });
     }
 
 } // namespace Stockfish
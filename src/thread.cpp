@@ -19,6 +19,9 @@
 #include <cassert>
 
 #include <algorithm> // For std::count
+#include <iomanip>
+#include <iostream>
+#include <sstream>
 #include "movegen.h"
 #include "search.h"
 #include "thread.h"
@@ -31,10 +34,88 @@ namespace Stockfish {
     ThreadPool Threads; // Global object
 
 
+    namespace {
+
+        // alloc_large() allocates memory of the threads from large pages, in the
+        // page size of the Large Pages option. The memory is placed by the first
+        // touch, see Thread::idle_loop(), except for large pages on Windows which
+        // are placed on the node of the allocating thread, see new_thread().
+
+        void* alloc_large(size_t size, const char* what) {
+
+            LargePageMode mode =  Options["Large Pages"] == "Off" ? LP_OFF
+                                : Options["Large Pages"] == "2MB" ? LP_2MB
+                                : Options["Large Pages"] == "1GB" ? LP_1GB : LP_AUTO;
+
+            void* mem = aligned_large_pages_alloc(size, mode);
+            if (!mem)
+            {
+                std::cerr << "Failed to allocate " << size / (1024 * 1024)
+                          << "MB for " << what << "." << std::endl;
+                std::exit(EXIT_FAILURE);
+            }
+
+            return mem;
+        }
+
+        // bind_threads() tells whether the threads are bound to NUMA nodes. If OS
+        // already scheduled us on a different group than 0 then don't overwrite the
+        // choice, eventually we are one of many one-threaded processes running on
+        // some Windows NUMA hardware, for instance in fishtest. To make it simple,
+        // just check if running threads are below a threshold, in this case all this
+        // NUMA machinery is not needed. NUMA Replicate always needs it, so that the
+        // threads stay on the node of the tables they use. On Linux the scheduler
+        // already spreads the threads over the nodes, so they are bound only for
+        // NUMA Replicate.
+
+        bool bind_threads() {
+
+            bool replicate = HasNuma && Options["NUMA Replicate"];
+
+#ifdef _WIN32
+            return Options["Threads"] > 8 || replicate;
+#else
+            return replicate;
+#endif
+        }
+
+        // placement() appends the size of the given memory and the pages and the
+        // NUMA nodes backing it, as actually obtained from the OS.
+
+        void placement(std::ostream& os, const void* mem, size_t bytes) {
+
+            size_t pageSize;
+            size_t largeBytes = large_pages_info(const_cast<void*>(mem), bytes, pageSize);
+            std::vector<size_t> nodes = memory_nodes(mem, bytes);
+
+            os << bytes / (1024 * 1024.0) << " MB, page size " << pageSize / 1024 << " kB, "
+               << largeBytes / (1024 * 1024.0) << " MB on large pages, placed on";
+
+            for (size_t n = 0; n < nodes.size(); ++n)
+                if (nodes[n])
+                    os << " node " << n << " " << nodes[n] / (1024 * 1024.0) << " MB";
+
+            if (nodes.empty())
+                os << " unknown nodes";
+        }
+
+    } // namespace
+
+
     // Thread constructor launches the thread and waits until it goes to sleep
     // in idle_loop(). Note that 'searching' and 'exit' should be already set.
-
-    Thread::Thread(size_t n) : idx(n), stdThread(&Thread::idle_loop, this) {
+    // The thread gets its own histories, or shares those of the given leader.
+
+    Thread::Thread(size_t n, Thread* leader) :
+        idx(n),
+        histories(leader ? leader->histories
+                         : static_cast<Histories*>(alloc_large(sizeof(Histories), "the histories"))),
+        ownsHistories(!leader),
+        counterMoves(histories->counterMoves),
+        mainHistory(histories->mainHistory),
+        captureHistory(histories->captureHistory),
+        continuationHistory(histories->continuationHistory),
+        stdThread(&Thread::idle_loop, this) {
 
         wait_for_search_finished();
     }
@@ -50,17 +131,59 @@ namespace Stockfish {
         exit = true;
         start_searching();
         stdThread.join();
+
+        if (ownsHistories)
+            aligned_large_pages_free(histories);
+    }
+
+
+    // Thread::operator new() allocates the thread from large pages, see alloc_large()
+
+    void* Thread::operator new(size_t size) {
+
+        return alloc_large(size, "a search thread");
+    }
+
+    void Thread::operator delete(void* mem) {
+
+        aligned_large_pages_free(mem);
     }
 
 
-    // Thread::clear() reset histories, usually before a new game
+    // Thread::pages_info() describes the memory of the thread, and of its
+    // histories if it owns them.
+
+    std::string Thread::pages_info() const {
+
+        std::stringstream ss;
+        ss << std::fixed << std::setprecision(1)
+           << "Thread " << idx << " runs on node " << numaNode << ", ";
+
+        placement(ss, this, sizeof(Thread));
+
+        if (ownsHistories)
+        {
+            ss << ", histories ";
+            placement(ss, histories, sizeof(Histories));
+        }
+
+        return ss.str();
+    }
+
+
+    // Thread::clear() reset histories, usually before a new game. Shared
+    // histories are reset by the leader of the group only.
 
     void Thread::clear() {
 
+        previousDepth = 0;
+
+        if (!ownsHistories)
+            return;
+
         counterMoves.fill(Move::none());
         mainHistory.fill(0);
         captureHistory.fill(0);
-        previousDepth = 0;
 
         for (bool inCheck : { false, true })
             for (StatsType c : { NoCaptures, Captures })
@@ -80,6 +203,22 @@ namespace Stockfish {
     }
 
 
+    // Thread::run_custom_job() wakes up the thread to run the given function
+    // instead of a search, e.g. to clear its part of the hash table. Like a
+    // search, the job is waited for with wait_for_search_finished().
+
+    void Thread::run_custom_job(std::function<void()> f) {
+
+        {
+            std::unique_lock<std::mutex> lk(mutex);
+            cv.wait(lk, [&] { return !searching; });
+            jobFunc = std::move(f);
+            searching = true;
+        }
+        cv.notify_one();
+    }
+
+
     // Thread::wait_for_search_finished() blocks on the condition variable
     // until the thread has finished searching.
 
@@ -95,14 +234,19 @@ namespace Stockfish {
 
     void Thread::idle_loop() {
 
-        // If OS already scheduled us on a different group than 0 then don't overwrite
-        // the choice, eventually we are one of many one-threaded processes running on
-        // some Windows NUMA hardware, for instance in fishtest. To make it simple,
-        // just check if running threads are below a threshold, in this case all this
-        // NUMA machinery is not needed.
-        if (Options["Threads"] > 8)
+        if (bind_threads())
             WinProcGroup::bindThisThread(idx);
 
+        if (HasNuma && Options["NUMA Replicate"])
+            Bitboards::use_local_tables();
+
+        // First touch of the tables and histories, from the thread itself after
+        // binding, so that the OS places their pages on the node of the thread
+        numaNode = WinProcGroup::numa_node();
+        pawnsTable.clear();
+        materialTable.clear();
+        clear();
+
         while (true)
         {
             std::unique_lock<std::mutex> lk(mutex);
@@ -113,12 +257,35 @@ namespace Stockfish {
             if (exit)
                 return;
 
+            std::function<void()> job = std::move(jobFunc);
+            jobFunc = nullptr;
+
             lk.unlock();
 
-            search();
+            if (job)
+                job();
+            else
+                search();
         }
     }
 
+    // new_thread() creates the thread of the given index. When the threads are
+    // bound to NUMA nodes, see idle_loop(), it is allocated from a helper thread
+    // bound in the same way, since large pages on Windows are placed when they
+    // are allocated.
+
+    template<typename T>
+    Thread* new_thread(size_t idx, Thread* leader) {
+
+        if (!bind_threads())
+            return new T(idx, leader);
+
+        Thread* th = nullptr;
+        std::thread([&] { WinProcGroup::bindThisThread(idx); th = new T(idx, leader); }).join();
+        return th;
+    }
+
+
     // ThreadPool::set() creates/destroys threads to match the requested number.
     // Created and launched threads will immediately go to sleep in idle_loop.
     // Upon resizing, threads are recreated to allow for binding if necessary.
@@ -127,7 +294,7 @@ namespace Stockfish {
 
         if (size() > 0)   // destroy any existing thread(s)
         {
-            main()->wait_for_search_finished();
+            wait_for_idle();
 
             while (size() > 0)
                 delete back(), pop_back();
@@ -135,10 +302,15 @@ namespace Stockfish {
 
         if (requested > 0) // create new thread(s)
         {
-            push_back(new MainThread(0));
+            // Consecutive threads, which are bound to the same NUMA node, share
+            // their histories in groups of historyGroup threads. Not in
+            // deterministic mode, where the threads must not see each other.
+            historyGroup = Options["Deterministic"] ? 1 : size_t(Options["History Sharing"]);
+
+            push_back(new_thread<MainThread>(0, nullptr));
 
             while (size() < requested)
-                push_back(new Thread(size()));
+                push_back(new_thread<Thread>(size(), size() % historyGroup ? at(size() - size() % historyGroup) : nullptr));
             clear();
 
             // Reallocate the hash with the new threadpool size
@@ -150,6 +322,26 @@ namespace Stockfish {
     }
 
 
+    // ThreadPool::report_pages() reports the memory of each thread as an info
+    // string, see Thread::pages_info(), and the memory saved by History Sharing.
+
+    void ThreadPool::report_pages() const {
+
+        for (Thread* th : *this)
+            sync_cout << "info string " << th->pages_info() << sync_endl;
+
+        const size_t tables = (size() + historyGroup - 1) / historyGroup;
+
+        std::stringstream ss;
+        ss << std::fixed << std::setprecision(1)
+           << "History Sharing " << historyGroup << ", " << tables << " histories of "
+           << sizeof(Histories) / (1024 * 1024.0) << " MB for " << size() << " threads, "
+           << (size() - tables) * sizeof(Histories) / (1024 * 1024.0) << " MB saved";
+
+        sync_cout << "info string " << ss.str() << sync_endl;
+    }
+
+
     // ThreadPool::clear() sets threadPool data to initial values
 
     void ThreadPool::clear() {
@@ -158,6 +350,7 @@ namespace Stockfish {
             th->clear();
 
         main()->callsCnt = 0;
+        main()->bestThreadPicks = main()->helperPicks = 0;
         main()->bestPreviousScore = VALUE_INFINITE;
         main()->bestPreviousAverageScore = VALUE_INFINITE;
         main()->previousTimeReduction = 1.0;
@@ -170,10 +363,11 @@ namespace Stockfish {
     void ThreadPool::start_thinking(Position& pos, StateListPtr& states,
         const Search::LimitsType& limits, bool ponderMode) {
 
-        main()->wait_for_search_finished();
+        wait_for_idle(); // A background TT clear may still be running
 
         main()->stopOnPonderhit = stop = false;
         increaseDepth = true;
+        deterministic = Options["Deterministic"] && size() > 1 && !limits.perft;
         main()->ponder = ponderMode;
         Search::Limits = limits;
         Search::RootMoves rootMoves;
@@ -183,9 +377,6 @@ namespace Stockfish {
                 || std::count(limits.searchmoves.begin(), limits.searchmoves.end(), m))
                 rootMoves.emplace_back(m);
 
-        if (!rootMoves.empty())
-            Tablebases::rank_root_moves(pos, rootMoves);
-
         // After ownership transfer 'states' becomes empty, so if we stop the search
         // and call 'go' again without setting a new position states.get() == NULL.
         assert(states.get() || setupStates.get());
@@ -193,54 +384,226 @@ namespace Stockfish {
         if (states.get())
             setupStates = std::move(states); // Ownership transfer, states is now empty
 
-        // In mate search we split rootMoves into smaller packages and each thread receives its own package.
-        // The more threads there are the smaller the packages.
-        // This speeds up the search to find the right first move in difficult positions
-        // e.g. those that involve sacrifices etc.
-        bool doSplit = false;
-        std::vector<Search::RootMoves> split(size());
+        // In a multithreaded mate search the main thread searches all the root moves,
+        // and the helper threads take them one at a time from a shared queue, so
+        // that a thread done with an easy move goes on with the next one while
+        // another one is still busy with a hard sacrifice line. See next_mate_move().
+        const bool useQueue = limits.mate > 0 && size() > 1 && rootMoves.size() > 1 && !deterministic;
+
+        mateQueue = useQueue ? rootMoves : Search::RootMoves();
+        mateRefuted.reset(useQueue ? new std::atomic_bool[rootMoves.size()]() : nullptr);
+        mateNext = 0;
+
+        // In deterministic mode the threads meet every syncNodes nodes, less often
+        // than the main thread checks the time, but often enough to honour small
+        // node limits.
+        syncArrived = syncLeft = 0;
+        stopRequested = false;
+        syncNodes = limits.nodes ? std::clamp(uint64_t(limits.nodes) / (4 * size()), uint64_t(64), uint64_t(4096)) : 4096;
+        TT.set_deterministic(deterministic ? size() : 0);
+        TT.set_policy(   Options["TT Replace"] == "Mate"
+                      || (Options["TT Replace"] == "Auto" && limits.mate) ? RP_MATE_PROOF : RP_DEPTH_AGE);
+
+        // Creators of the TT entries are tracked only for the SMPStats reports
+        const bool trackWriters = Options["SMPStats"] && size() > 1 && !deterministic;
+        TT.track_writers(trackWriters);
+
+        // Each thread sets up its own copy of the root position and root moves,
+        // all of them in parallel. The rootState is per thread, earlier states are
+        // shared since they are read-only. A single thread is set up from here,
+        // which saves waking it up and waiting for it twice per search.
+        assert(pos.state() == &setupStates->back());
+
+        auto setup = [&](Thread* th) {
+
+            th->nextSyncNodes = syncNodes;
+            th->nodes = th->tbHits = th->bestMoveChanges = 0;
+            th->ttProbes = th->ttHits = 0;
+            th->busyTime = 0;
+            th->hitsFrom.assign(trackWriters ? size() : 0, 0);
+            th->mateItems = 0;
+            th->nmpMinPly = 0;
+            th->rootDepth = th->completedDepth = 0;
+            th->rootMoves = rootMoves;
+            th->rootPos.set(pos, &th->rootState, th);
+        };
 
-        if (limits.mate && size() > 1) // only makes sense for multi-threaded search
+        if (size() == 1)
+            setup(main());
+        else
         {
-            doSplit = true;
-            int i = 0;
-            for (const auto& rm : rootMoves)
-            {
-                split[i].emplace_back(rm.pv[0]);
-                if (++i >= size()) i = 0;
-            }
+            for (Thread* th : *this)
+                th->run_custom_job([&setup, th]() { setup(th); });
 
-            for (auto& v : split)
-                if (v.empty()) v = rootMoves; // possible empty packages receive the full rootMoves
+            wait_for_idle();
         }
 
-        // We use Position::set() to set root position across threads. But there are
-        // some StateInfo fields (previous, pliesFromNull, capturedPiece) that cannot
-        // be deduced from a fen string, so set() clears them and they are set from
-        // setupStates->back() later. The rootState is per thread, earlier states are shared
-        // since they are read-only.
-        for (Thread* th : *this)
+        main()->start_searching();
+    }
+
+    // ThreadPool::sync() is called by each thread in deterministic mode every
+    // syncNodes nodes. Between two sync points threads do not see each other's
+    // TT writes (see TranspositionTable::probe()), so what a thread searches
+    // depends only on its own node count, not on the OS scheduling. At the sync
+    // point all threads still searching wait for each other, then replay the
+    // logged TT writes into the table in thread order, each thread taking care
+    // of some table partitions. Stop requests and the nodes limit are applied
+    // here too, so every thread stops after the same number of nodes in every run.
+
+    void ThreadPool::sync(Thread* th) {
+
+        std::unique_lock<std::mutex> lk(syncMutex);
+
+        const size_t rank = syncArrived++;
+        const uint64_t round = syncRound;
+
+        if (syncArrived + syncLeft == size())
+            start_commit();
+        else
+            syncCv.wait(lk, [&] { return syncRound != round; });
+
+        const size_t committers = syncCommitters;
+        lk.unlock();
+
+        for (size_t part = rank; part < size(); part += committers)
+            TT.commit_deterministic(part);
+
+        lk.lock();
+
+        if (--syncPending == 0)
+            end_round();
+        else
+            syncCv.wait(lk, [&] { return syncRound == round + 2; });
+
+        th->nextSyncNodes += syncNodes;
+    }
+
+
+    // ThreadPool::leave_sync() is called by each thread in deterministic mode
+    // when it has finished searching, so that the others no longer wait for it.
+    // The main thread uses it to stop the others at their next sync point when
+    // the target depth is reached.
+
+    void ThreadPool::leave_sync(Thread*, bool stopOthers) {
+
+        std::unique_lock<std::mutex> lk(syncMutex);
+
+        stopRequested |= stopOthers;
+
+        if (++syncLeft == size())
         {
-            th->nodes = th->tbHits = th->bestMoveChanges = 0;
-            th->nmpMinPly = 0;
-            th->rootDepth = th->completedDepth = 0;
-            th->rootMoves = rootMoves;
-            th->rootPos.set(pos.fen(), pos.is_chess960(), &th->rootState, th);
-            th->rootState = setupStates->back();
+            // Last one out, keep the TT writes for the next search
+            for (size_t part = 0; part < size(); ++part)
+                TT.commit_deterministic(part);
         }
+        else if (syncArrived && syncArrived + syncLeft == size())
+            start_commit();
+    }
 
-        main()->start_searching();
+
+    // ThreadPool::request_stop() stops the search immediately, or at the next
+    // sync point in deterministic mode.
+
+    void ThreadPool::request_stop() {
+
+        if (!deterministic)
+        {
+            stop = true;
+            return;
+        }
+
+        std::unique_lock<std::mutex> lk(syncMutex);
+        stopRequested = true;
+
+        // No sync point to come if all the threads have already finished
+        if (syncLeft == size())
+            stop = true;
     }
 
+
+    // ThreadPool::start_commit() and end_round() advance the barrier of sync()
+    // through its two phases. Called with syncMutex held.
+
+    void ThreadPool::start_commit() {
+
+        syncCommitters = syncPending = syncArrived;
+        ++syncRound;
+        syncCv.notify_all();
+    }
+
+    void ThreadPool::end_round() {
+
+        TT.new_deterministic_round();
+
+        if (stopRequested || (Search::Limits.nodes && nodes_searched() >= uint64_t(Search::Limits.nodes)))
+            stop = true;
+
+        syncArrived = 0;
+        ++syncRound;
+        syncCv.notify_all();
+    }
+
+
+    // ThreadPool::next_mate_move() gives a helper thread of a multithreaded mate
+    // search its next root move, and the depth to search it to. The queue is
+    // lock-free: each call takes the next item with an atomic increment. The items
+    // cycle through the root moves in rounds of increasing depth, starting from
+    // the depth of the mate, and skip the moves known to lose. Returns false when
+    // all of them lose.
+
+    bool ThreadPool::next_mate_move(Search::RootMoves& rootMoves, Depth& depth) {
+
+        const size_t n = mateQueue.size();
+
+        for (size_t tries = 0; tries < n; ++tries)
+        {
+            const size_t item = mateNext.fetch_add(1, std::memory_order_relaxed);
+
+            if (mateRefuted[item % n].load(std::memory_order_relaxed))
+                continue;
+
+            rootMoves.assign(1, mateQueue[item % n]);
+            depth = 2 * Search::Limits.mate - 1 + 2 * Depth(item / n);
+            return true;
+        }
+
+        return false;
+    }
+
+
+    // ThreadPool::refute_mate_move() removes from the queue a root move that loses
+
+    void ThreadPool::refute_mate_move(Move m) {
+
+        auto it = std::find(mateQueue.begin(), mateQueue.end(), m);
+
+        if (it != mateQueue.end())
+            mateRefuted[it - mateQueue.begin()] = true;
+    }
+
+
     Thread* ThreadPool::get_best_thread() const {
 
         Thread* bestThread = front();
+
+        if (size() == 1)
+            return bestThread;
+
         std::unordered_map<Move, int64_t, Move::MoveHash> votes;
         Value minScore = VALUE_NONE;
 
+        // A helper of a multithreaded mate search has searched a single root move,
+        // so its score is not a score of the position unless it proves a win.
+        auto candidate = [&](Thread* th) {
+            return   th == front()
+                  || !use_mate_queue()
+                  || th->rootMoves[0].score >= VALUE_TB_WIN_IN_MAX_PLY;
+            };
+
         // Find minimum score of all threads
         for (Thread* th : *this)
-            minScore = std::min(minScore, th->rootMoves[0].score);
+            if (candidate(th))
+                minScore = std::min(minScore, th->rootMoves[0].score);
 
         // Vote according to score and depth, and select the best thread
         auto thread_value = [minScore](Thread* th) {
@@ -248,10 +611,14 @@ namespace Stockfish {
             };
 
         for (Thread* th : *this)
-            votes[th->rootMoves[0].pv[0]] += thread_value(th);
+            if (candidate(th))
+                votes[th->rootMoves[0].pv[0]] += thread_value(th);
 
         for (Thread* th : *this)
-            if (std::abs(bestThread->rootMoves[0].score) >= VALUE_TB_WIN_IN_MAX_PLY)
+            if (!candidate(th))
+                continue;
+
+            else if (std::abs(bestThread->rootMoves[0].score) >= VALUE_TB_WIN_IN_MAX_PLY)
             {
                 // Make sure we pick the shortest mate / TB conversion or stave off mate the longest
                 if (th->rootMoves[0].score > bestThread->rootMoves[0].score)
@@ -287,4 +654,14 @@ namespace Stockfish {
                 th->wait_for_search_finished();
     }
 
+
+    // Wait for all threads, main included, to be parked in idle_loop(). Must not
+    // be called from one of the pool threads.
+
+    void ThreadPool::wait_for_idle() const {
+
+        for (Thread* th : *this)
+            th->wait_for_search_finished();
+    }
+
 } // namespace Stockfish
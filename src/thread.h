@@ -21,7 +21,10 @@
 
 #include <atomic>
 #include <condition_variable>
+#include <functional>
+#include <memory>
 #include <mutex>
+#include <string>
 #include <thread>
 #include <vector>
 
@@ -34,10 +37,27 @@
 
 namespace Stockfish {
 
+    // Histories holds the move ordering statistics of a search thread. With the
+    // History Sharing option, the threads of a group share one of them, updated
+    // without synchronization like the transposition table.
+
+    struct Histories {
+        CounterMoveHistory counterMoves;
+        ButterflyHistory mainHistory;
+        CapturePieceToHistory captureHistory;
+        ContinuationHistory continuationHistory[2][2];
+    };
+
+
     // Thread class keeps together all the thread-related stuff. We use
     // per-thread pawn and material hash tables so that once we get a
     // pointer to an entry its life time is unlimited and we don't have
     // to care about someone changing the entry under our feet.
+    //
+    // Threads and their histories are allocated from large pages, and first
+    // touched by the thread itself, so that they are placed on the NUMA node
+    // the thread runs on. The big members come last, so that the page touched
+    // by the constructor holds as little of them as possible.
 
     class Thread {
 
@@ -45,23 +65,55 @@ namespace Stockfish {
         std::condition_variable cv;
         size_t idx;
         bool exit = false, searching = true; // Set before starting std::thread
+        std::function<void()> jobFunc;
+        Histories* histories;
+        bool ownsHistories;
+
+    public:
+        // Bound before stdThread starts, to the histories of the thread or of
+        // the leader of its group, see ThreadPool::set()
+        CounterMoveHistory& counterMoves;
+        ButterflyHistory& mainHistory;
+        CapturePieceToHistory& captureHistory;
+        ContinuationHistory (&continuationHistory)[2][2];
+
+    private:
         NativeThread stdThread;
 
     public:
-        explicit Thread(size_t);
+        explicit Thread(size_t, Thread* leader = nullptr);
         virtual ~Thread();
+        static void* operator new(size_t size);
+        static void operator delete(void* mem);
+        std::string pages_info() const;
         virtual void search();
         void clear();
         void idle_loop();
         void start_searching();
+        void run_custom_job(std::function<void()> f);
         void wait_for_search_finished();
         size_t id() const { return idx; }
 
-        Pawns::Table pawnsTable;
-        Material::Table materialTable;
+        // The counters are written only by the thread itself, other threads just
+        // read them, so they are incremented without a locked read-modify-write
+        void count_node()   { nodes.store(nodes.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed); }
+        void count_tb_hit() { tbHits.store(tbHits.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed); }
+
+        uint64_t nextSyncNodes; // Node count of the next sync point in deterministic mode
+
+        // A thread searching on its own, as in datagen, stops at its own node
+        // limit instead of at Threads.stop, see search_stopped()
+        uint64_t nodesLimit = 0;
+        bool limitReached = false;
+        bool search_stopped() const;
+
         size_t pvIdx, pvLast;
         RunningAverage complexityAverage;
         std::atomic<uint64_t> nodes, tbHits, bestMoveChanges;
+        uint64_t ttProbes, ttHits;
+        TimePoint busyTime;
+        std::vector<uint64_t> hitsFrom; // [creator], TT hits on entries of this search, with SMPStats
+        size_t mateItems;               // Root moves taken from the mate queue
         int selDepth, nmpMinPly;
         Color nmpColor;
         Value bestValue;
@@ -72,10 +124,10 @@ namespace Stockfish {
         Search::RootMoves rootMoves;
         Depth rootDepth, completedDepth, previousDepth;
         int rootDelta;
-        CounterMoveHistory counterMoves;
-        ButterflyHistory mainHistory;
-        CapturePieceToHistory captureHistory;
-        ContinuationHistory continuationHistory[2][2];
+        int numaNode; // Node the thread first touched its state from, -1 if unknown
+
+        Pawns::Table pawnsTable;
+        Material::Table materialTable;
     };
 
 
@@ -86,6 +138,10 @@ namespace Stockfish {
         using Thread::Thread;
 
         void search() override;
+        void rank_root_moves();
+        bool prove_mate();
+        void record_metrics(const Thread* bestThread);
+        void smp_stats(const Thread* bestThread);
         void check_time();
 
         double previousTimeReduction;
@@ -93,6 +149,7 @@ namespace Stockfish {
         Value bestPreviousAverageScore;
         Value iterValue[4];
         int callsCnt;
+        uint64_t bestThreadPicks, helperPicks;
         bool stopOnPonderhit;
         std::atomic_bool ponder;
     };
@@ -107,6 +164,7 @@ namespace Stockfish {
         void start_thinking(Position&, StateListPtr&, const Search::LimitsType&, bool = false);
         void clear();
         void set(size_t);
+        void report_pages() const;
 
         MainThread* main()        const { return static_cast<MainThread*>(front()); }
         uint64_t nodes_searched() const { return accumulate(&Thread::nodes); }
@@ -114,12 +172,36 @@ namespace Stockfish {
         Thread* get_best_thread() const;
         void start_searching();
         void wait_for_search_finished() const;
+        void wait_for_idle() const;
+        void sync(Thread* th);
+        void leave_sync(Thread* th, bool stopOthers);
+        void request_stop();
+        bool use_mate_queue() const { return !mateQueue.empty(); }
+        bool next_mate_move(Search::RootMoves& rootMoves, Depth& depth);
+        void refute_mate_move(Move m);
 
         std::atomic_bool stop, increaseDepth;
+        bool deterministic = false;
+        size_t historyGroup = 1; // Threads sharing the same histories
 
     private:
+        void start_commit();
+        void end_round();
+
         StateListPtr setupStates;
 
+        // Root moves of a multithreaded mate search, shared by the helper threads
+        Search::RootMoves mateQueue;
+        std::unique_ptr<std::atomic_bool[]> mateRefuted;
+        std::atomic<size_t> mateNext;
+
+        // Barrier state of deterministic mode, see sync()
+        std::mutex syncMutex;
+        std::condition_variable syncCv;
+        size_t syncArrived, syncLeft, syncPending, syncCommitters;
+        uint64_t syncRound = 0, syncNodes;
+        bool stopRequested;
+
         uint64_t accumulate(std::atomic<uint64_t> Thread::* member) const {
 
             uint64_t sum = 0;
@@ -131,6 +213,10 @@ namespace Stockfish {
 
     extern ThreadPool Threads;
 
+    inline bool Thread::search_stopped() const {
+        return Threads.stop.load(std::memory_order_relaxed) || limitReached;
+    }
+
 } // namespace Stockfish
 
 #endif // #ifndef THREAD_H_INCLUDED
@@ -18,7 +18,7 @@
 
 #include <cstring>   // For std::memset
 #include <iostream>
-#include <thread>
+#include <sstream>
 
 #include "bitboard.h"
 #include "misc.h"
@@ -30,11 +30,35 @@ namespace Stockfish {
 
 TranspositionTable TT; // Our global transposition table
 
+namespace {
+
+// A lower bound beyond the mate scores proves a mate, an upper bound below
+// the mated scores proves being mated.
+
+bool proves_mate(Value v, Bound b) {
+  return   ((b & BOUND_LOWER) && v >= VALUE_MATE_IN_MAX_PLY)
+        || ((b & BOUND_UPPER) && v <= VALUE_MATED_IN_MAX_PLY);
+}
+
+} // namespace
+
 // TTEntry::save() populates the TTEntry with a new node's data, possibly
 // overwriting an old position. Update is not atomic and can be racy.
 
 void TTEntry::save(Key k, Value v, bool pv, Bound b, Depth d, Move m, Value ev) {
 
+  // In deterministic mode the search only writes to private caches, and the
+  // write is logged to be replayed into the shared table at the next sync point.
+  if (TT.detTable)
+      TT.log_save(this, { k, v, ev, d, m, b, pv });
+
+  // With RP_MATE_PROOF a proven mate is only overwritten by another proof
+  if (   TT.policy == RP_MATE_PROOF
+      && (uint16_t)k == key16
+      && proves_mate(value(), bound())
+      && !proves_mate(v, b))
+      return;
+
   // Preserve any existing move for the same position
   if (m || (uint16_t)k != key16)
       move16 = m.raw();
@@ -62,13 +86,17 @@ void TTEntry::save(Key k, Value v, bool pv, Bound b, Depth d, Move m, Value ev)
 
 void TranspositionTable::resize(size_t mbSize) {
 
-  Threads.main()->wait_for_search_finished();
+  Threads.wait_for_idle();
 
   aligned_large_pages_free(table);
 
   clusterCount = mbSize * 1024 * 1024 / sizeof(Cluster);
 
-  table = static_cast<Cluster*>(aligned_large_pages_alloc(clusterCount * sizeof(Cluster)));
+  LargePageMode mode =  Options["Large Pages"] == "Off" ? LP_OFF
+                      : Options["Large Pages"] == "2MB" ? LP_2MB
+                      : Options["Large Pages"] == "1GB" ? LP_1GB : LP_AUTO;
+
+  table = static_cast<Cluster*>(aligned_large_pages_alloc(clusterCount * sizeof(Cluster), mode));
   if (!table)
   {
       std::cerr << "Failed to allocate " << mbSize
@@ -76,37 +104,86 @@ void TranspositionTable::resize(size_t mbSize) {
       exit(EXIT_FAILURE);
   }
 
-  clear();
+  // Zeroing the table touches every page from the search threads, so this also
+  // pre-faults the whole table and the first search hits no page faults.
+  zero_fill();
+  Threads.wait_for_idle();
+}
+
+
+// TranspositionTable::track_writers() allocates the creators of the entries for
+// the SMPStats reports, or frees them. Called before each search, so that they
+// follow the size of the table.
+
+void TranspositionTable::track_writers(bool on) {
+
+  const size_t n = on ? clusterCount * ClusterSize : 0;
+
+  if (writers.size() != n)
+  {
+      writers.assign(n, 0);
+      writers.shrink_to_fit();
+  }
+}
+
+
+// TranspositionTable::pages_info() describes the pages backing the table, as
+// actually obtained from the OS.
+
+std::string TranspositionTable::pages_info() const {
+
+  size_t pageSize, bytes = clusterCount * sizeof(Cluster);
+  size_t largeBytes = large_pages_info(table, bytes, pageSize);
+
+  std::stringstream ss;
+  ss << "Hash " << bytes / (1024 * 1024) << " MB, page size " << pageSize / 1024
+     << " kB, " << largeBytes / (1024 * 1024) << " MB on large pages";
+
+  return ss.str();
 }
 
 
-// TranspositionTable::clear() initializes the entire transposition table to zero,
-//  in a multi-threaded way.
+// TranspositionTable::clear() logically empties the table in O(1): it starts a
+// new epoch, and probe() treats clusters of older epochs as empty. Only when
+// the epoch counter wraps around the memory is actually zeroed.
 
 void TranspositionTable::clear() {
 
-  std::vector<std::thread> threads;
+  if (++epoch16 == 0)
+      zero_fill();
+}
+
+
+// TranspositionTable::zero_fill() initializes the entire transposition table to
+// zero, in a multi-threaded way. The work is handed to the idle search threads,
+// which are already bound to their NUMA node, so each thread zeroes (and
+// first-touches) the part of the table closest to it. The call returns
+// immediately: the next search, resize() or ThreadPool::wait_for_idle() waits
+// for the zeroing to finish.
+
+void TranspositionTable::zero_fill() {
 
-  for (size_t idx = 0; idx < Options["Threads"]; ++idx)
+  const size_t threadCount = Threads.size();
+
+  epoch16 = 0;
+
+  if (!threadCount) // No search threads yet, or anymore
   {
-      threads.emplace_back([this, idx]() {
+      std::memset(table, 0, clusterCount * sizeof(Cluster));
+      return;
+  }
 
-          // Thread binding gives faster search on systems with a first-touch policy
-          if (Options["Threads"] > 8)
-              WinProcGroup::bindThisThread(idx);
+  for (size_t idx = 0; idx < threadCount; ++idx)
+      Threads[idx]->run_custom_job([this, idx, threadCount]() {
 
           // Each thread will zero its part of the hash table
-          const size_t stride = size_t(clusterCount / Options["Threads"]),
-                       start  = size_t(stride * idx),
-                       len    = idx != Options["Threads"] - 1 ?
+          const size_t stride = clusterCount / threadCount,
+                       start  = stride * idx,
+                       len    = idx != threadCount - 1 ?
                                 stride : clusterCount - start;
 
           std::memset(&table[start], 0, len * sizeof(Cluster));
       });
-  }
-
-  for (std::thread& th : threads)
-      th.join();
 }
 
 
@@ -114,14 +191,50 @@ void TranspositionTable::clear() {
 // table. It returns true and a pointer to the TTEntry if the position is found.
 // Otherwise, it returns false and a pointer to an empty or least valuable TTEntry
 // to be replaced later. The replace value of an entry is calculated as its depth
-// minus 8 times its relative age. TTEntry t1 is considered more valuable than
+// minus 8 times its relative age, see find_entry(). TTEntry t1 is considered more valuable than
 // TTEntry t2 if its replace value is greater than that of t2.
 
-TTEntry* TranspositionTable::probe(const Key key, bool& found) const {
+TTEntry* TranspositionTable::probe(const Key key, bool& found, Thread* th) const {
+
+  if (detTable && th)
+      return probe_deterministic(key, found, th->id());
+
+  TTEntry* tte = find_entry(&table[mul_hi64(key, clusterCount)], key, found, epoch16);
+
+  // With SMPStats a miss makes the probing thread the creator of the entry, and
+  // a hit is counted by creator if the entry was created in the current search.
+  if (!writers.empty() && th)
+  {
+      const size_t offset = size_t((const char*)tte - (const char*)table);
+      uint16_t& w = writers[offset / sizeof(Cluster) * ClusterSize + offset % sizeof(Cluster) / sizeof(TTEntry)];
+      const uint16_t gen = uint16_t((generation8 >> GENERATION_BITS) << 11);
+
+      if (!found)
+          w = uint16_t(gen | (th->id() + 1));
+
+      else if ((w & 0xF800) == gen && (w & 0x7FF) && size_t(w & 0x7FF) <= th->hitsFrom.size())
+          th->hitsFrom[(w & 0x7FF) - 1]++;
+  }
+
+  return tte;
+}
+
 
-  TTEntry* const tte = first_entry(key);
+// TranspositionTable::find_entry() implements probe() for a given cluster, of
+// the table or of a private cache.
+
+TTEntry* TranspositionTable::find_entry(Cluster* cl, const Key key, bool& found, uint16_t epoch) const {
+
+  TTEntry* const tte = &cl->entry[0];
   const uint16_t key16 = (uint16_t)key;  // Use the low 16 bits as key inside the cluster
 
+  // Entries written before the last clear() count as empty
+  if (cl->epoch16 != epoch)
+  {
+      std::memset(tte, 0, sizeof(cl->entry));
+      cl->epoch16 = epoch;
+  }
+
   for (int i = 0; i < ClusterSize; ++i)
       if (tte[i].key16 == key16 || !tte[i].depth8)
       {
@@ -130,22 +243,116 @@ TTEntry* TranspositionTable::probe(const Key key, bool& found) const {
           return found = (bool)tte[i].depth8, &tte[i];
       }
 
-  // Find an entry to be replaced according to the replacement strategy
+  // Find an entry to be replaced according to the replacement strategy.
+  // Due to our packed storage format for generation and its cyclic
+  // nature we add GENERATION_CYCLE (256 is the modulus, plus what
+  // is needed to keep the unrelated lowest n bits from affecting
+  // the result) to calculate the entry age correctly even after
+  // generation8 overflows into the next cycle. With RP_MATE_PROOF the
+  // proofs of a mate of the current search are worth more than any other
+  // entry, while those of earlier searches age out like the others.
+  auto worth = [&](const TTEntry* e) {
+      int age = (GENERATION_CYCLE + generation8 - e->genBound8) & GENERATION_MASK;
+      return e->depth8 - age
+            + (policy == RP_MATE_PROOF && !age && proves_mate(e->value(), e->bound()) ? 256 : 0);
+  };
+
   TTEntry* replace = tte;
   for (int i = 1; i < ClusterSize; ++i)
-      // Due to our packed storage format for generation and its cyclic
-      // nature we add GENERATION_CYCLE (256 is the modulus, plus what
-      // is needed to keep the unrelated lowest n bits from affecting
-      // the result) to calculate the entry age correctly even after
-      // generation8 overflows into the next cycle.
-      if (  replace->depth8 - ((GENERATION_CYCLE + generation8 - replace->genBound8) & GENERATION_MASK)
-          >   tte[i].depth8 - ((GENERATION_CYCLE + generation8 -   tte[i].genBound8) & GENERATION_MASK))
+      if (worth(replace) > worth(&tte[i]))
           replace = &tte[i];
 
   return found = false, replace;
 }
 
 
+// In deterministic mode the shared table is read-only between two sync points.
+// Each thread sees its own writes through a small private cache, which is
+// emptied at every sync point, once the writes have been replayed into the
+// table. probe_deterministic() looks up the private cache first, then the
+// table, and always returns a private entry.
+
+TTEntry* TranspositionTable::probe_deterministic(const Key key, bool& found, size_t idx) const {
+
+  TTEntry* tte = find_entry(&detTable[idx * DetClusterCount + mul_hi64(key, DetClusterCount)], key, found, detEpoch16);
+
+  if (found)
+      return tte;
+
+  const Cluster* cl = &table[mul_hi64(key, clusterCount)];
+
+  if (cl->epoch16 == epoch16)
+      for (int i = 0; i < ClusterSize; ++i)
+          if (cl->entry[i].key16 == (uint16_t)key && cl->entry[i].depth8)
+          {
+              *tte = cl->entry[i];
+              tte->genBound8 = uint8_t(generation8 | (tte->genBound8 & (GENERATION_DELTA - 1)));
+
+              return found = true, tte;
+          }
+
+  return tte;
+}
+
+
+// TranspositionTable::log_save() records a write to a private cache. Writes are
+// bucketed by the table partition they fall into, so that the partitions can be
+// replayed in parallel, each one in thread order, by commit_deterministic().
+
+void TranspositionTable::log_save(const TTEntry* tte, const Save& s) {
+
+  const size_t offset = size_t((const char*)tte - (const char*)detTable);
+
+  if (offset >= detThreads * DetClusterCount * sizeof(Cluster)) // Not a private entry
+      return;
+
+  const size_t idx  = offset / (DetClusterCount * sizeof(Cluster)),
+               part = mul_hi64(s.key, clusterCount) * detThreads / clusterCount;
+
+  detLogs[idx * detThreads + part].push_back(s);
+}
+
+
+// TranspositionTable::set_deterministic() enables the private caches for the
+// given number of threads, or disables them if threadCount is zero. Called
+// before each search.
+
+void TranspositionTable::set_deterministic(size_t threadCount) {
+
+  if (threadCount != detThreads)
+  {
+      detThreads = threadCount;
+      detClusters.assign(threadCount * DetClusterCount, Cluster());
+      detLogs.assign(threadCount * threadCount, std::vector<Save>());
+      detEpoch16 = 0;
+  }
+
+  for (auto& log : detLogs)
+      log.clear();
+
+  detTable = threadCount ? detClusters.data() : nullptr;
+  new_deterministic_round();
+}
+
+
+// TranspositionTable::commit_deterministic() replays the logged writes of all
+// threads, in thread order, into one partition of the table.
+
+void TranspositionTable::commit_deterministic(size_t part) {
+
+  bool found;
+
+  for (size_t idx = 0; idx < detThreads; ++idx)
+  {
+      for (const Save& s : detLogs[idx * detThreads + part])
+          find_entry(&table[mul_hi64(s.key, clusterCount)], s.key, found, epoch16)
+              ->save(s.key, s.value, s.pv, s.bound, s.depth, s.move, s.eval);
+
+      detLogs[idx * detThreads + part].clear();
+  }
+}
+
+
 // TranspositionTable::hashfull() returns an approximation of the hashtable
 // occupation during a search. The hash is x permill full, as per UCI protocol.
 
@@ -153,8 +360,9 @@ int TranspositionTable::hashfull() const {
 
   int cnt = 0;
   for (int i = 0; i < 1000; ++i)
-      for (int j = 0; j < ClusterSize; ++j)
-          cnt += table[i].entry[j].depth8 && (table[i].entry[j].genBound8 & GENERATION_MASK) == generation8;
+      if (table[i].epoch16 == epoch16)
+          for (int j = 0; j < ClusterSize; ++j)
+              cnt += table[i].entry[j].depth8 && (table[i].entry[j].genBound8 & GENERATION_MASK) == generation8;
 
   return cnt / ClusterSize;
 }
@@ -19,11 +19,16 @@
 #ifndef TT_H_INCLUDED
 #define TT_H_INCLUDED
 
+#include <string>
+#include <vector>
+
 #include "misc.h"
 #include "types.h"
 
 namespace Stockfish {
 
+class Thread;
+
 // TTEntry struct is the 10 bytes transposition table entry, defined as below:
 //
 // key        16 bit
@@ -57,11 +62,22 @@ private:
 };
 
 
+// Replacement policies of the transposition table. RP_DEPTH_AGE keeps the
+// deepest and most recent entries. RP_MATE_PROOF does the same but keeps the
+// bounds that prove a mate whenever possible, for mate searches.
+
+enum ReplacePolicy { RP_DEPTH_AGE, RP_MATE_PROOF };
+
+
 // A TranspositionTable is an array of Cluster, of size clusterCount. Each
 // cluster consists of ClusterSize number of TTEntry. Each non-empty TTEntry
 // contains information on exactly one position. The size of a Cluster should
 // divide the size of a cache line for best performance, as the cacheline is
 // prefetched when possible.
+//
+// Each cluster also records the epoch it was last written in. clear() only
+// bumps the table epoch, and clusters of an older epoch are treated as empty
+// (and reset) the first time they are probed afterwards.
 
 class TranspositionTable {
 
@@ -69,7 +85,7 @@ class TranspositionTable {
 
   struct Cluster {
     TTEntry entry[ClusterSize];
-    char padding[2]; // Pad to 32 bytes
+    uint16_t epoch16; // Pads to 32 bytes
   };
 
   static_assert(sizeof(Cluster) == 32, "Unexpected Cluster size");
@@ -83,10 +99,21 @@ class TranspositionTable {
 public:
  ~TranspositionTable() { aligned_large_pages_free(table); }
   void new_search() { generation8 += GENERATION_DELTA; } // Lower bits are used for other things
-  TTEntry* probe(const Key key, bool& found) const;
+  TTEntry* probe(const Key key, bool& found, Thread* th = nullptr) const;
   int hashfull() const;
   void resize(size_t mbSize);
   void clear();
+  void zero_fill();
+  std::string pages_info() const;
+  void set_policy(ReplacePolicy p) { policy = p; }
+
+  // Deterministic multithreaded search, see ThreadPool::sync()
+  void set_deterministic(size_t threadCount);
+  void commit_deterministic(size_t part);
+  void new_deterministic_round() { if (++detEpoch16 == 0) detClusters.assign(detClusters.size(), Cluster()); }
+
+  // Lazy SMP statistics, see MainThread::smp_stats()
+  void track_writers(bool on);
 
   TTEntry* first_entry(const Key key) const {
     return &table[mul_hi64(key, clusterCount)].entry[0];
@@ -95,9 +122,37 @@ public:
 private:
   friend struct TTEntry;
 
+  // A TT write made in deterministic mode, replayed into the table at the next sync point
+  struct Save {
+    Key key;
+    Value value, eval;
+    Depth depth;
+    Move move;
+    Bound bound;
+    bool pv;
+  };
+
+  // Clusters of the per-thread private caches used in deterministic mode
+  static constexpr size_t DetClusterCount = 1 << 14;
+
+  TTEntry* find_entry(Cluster* cl, const Key key, bool& found, uint16_t epoch) const;
+  TTEntry* probe_deterministic(const Key key, bool& found, size_t idx) const;
+  void log_save(const TTEntry* tte, const Save& s);
+
   size_t clusterCount;
   Cluster* table;
   uint8_t generation8; // Size must be not bigger than TTEntry::genBound8
+  uint16_t epoch16;
+  ReplacePolicy policy = RP_DEPTH_AGE;
+
+  Cluster* detTable = nullptr; // Private caches of all threads, nullptr if not deterministic
+  size_t detThreads = 0;
+  uint16_t detEpoch16 = 0;
+  std::vector<Cluster> detClusters;
+  std::vector<std::vector<Save>> detLogs; // [thread * detThreads + partition]
+
+  // With SMPStats, the thread that created each entry and the generation, see probe()
+  mutable std::vector<uint16_t> writers;
 };
 
 extern TranspositionTable TT;
@@ -35,6 +35,12 @@
 //
 // -DUSE_PEXT    | Add runtime support for use of pext asm-instruction. Works
 //               | only in 64-bit mode and requires hardware with pext support.
+//
+// -DUSE_PDEP    | Store the slider attacks compressed to 16 bits and expand
+//               | them with the pdep asm-instruction. Requires -DUSE_PEXT.
+//
+// -DUSE_NUMA    | Look up the attack tables through a per-thread pointer, so
+//               | that the NUMA Replicate option can give each NUMA node its copy.
 
 #include <cassert>
 #include <cctype>
@@ -71,10 +77,12 @@
 #endif
 
 #if defined(USE_PEXT)
-#include <immintrin.h> // Header for _pext_u64() intrinsic
+#include <immintrin.h> // Header for _pext_u64() and _pdep_u64() intrinsics
 #define pext(b, m) _pext_u64(b, m)
+#define pdep(b, m) _pdep_u64(b, m)
 #else
 #define pext(b, m) 0
+#define pdep(b, m) 0
 #endif
 
 namespace Stockfish {
@@ -91,6 +99,18 @@ namespace Stockfish {
     constexpr bool HasPext = false;
 #endif
 
+#if defined(USE_PEXT) && defined(USE_PDEP)
+    constexpr bool HasPdep = true;
+#else
+    constexpr bool HasPdep = false;
+#endif
+
+#ifdef USE_NUMA
+    constexpr bool HasNuma = true;
+#else
+    constexpr bool HasNuma = false;
+#endif
+
 #ifdef IS_64BIT
     constexpr bool Is64Bit = true;
 #else
@@ -23,6 +23,8 @@
 #include <sstream>
 #include <string>
 
+#include "analysis.h"
+#include "datagen.h"
 #include "evaluate.h"
 #include "movegen.h"
 #include "position.h"
@@ -87,7 +89,7 @@ namespace {
 
     StateListPtr states(new std::deque<StateInfo>(1));
     Position p;
-    p.set(pos.fen(), Options["UCI_Chess960"], &states->back(), Threads.main());
+    p.set(pos, &states->back(), Threads.main());
 
     sync_cout << "\n" << Eval::trace(p) << sync_endl;
   }
@@ -184,7 +186,7 @@ namespace {
         }
         else if (token == "setoption")  setoption(is);
         else if (token == "position")   position(pos, is, states);
-        else if (token == "ucinewgame") { Search::clear(); elapsed = now(); } // Search::clear() may take a while
+        else if (token == "ucinewgame") { Search::clear(); Threads.wait_for_idle(); elapsed = now(); } // Search::clear() may take a while
     }
 
     elapsed = now() - elapsed + 1; // Ensure positivity to avoid a 'divide by zero'
@@ -219,7 +221,7 @@ namespace {
           unsigned posCount = 0;
           std::ofstream csv("matelog " + current_date() + ".csv");
           csv << "Hash " << int(Options["Hash"]) << " MB;Threads " << int(Options["Threads"]) << std::endl;
-          csv << "Index;FEN;Mate in;Time [ms];PV" << std::endl;
+          csv << "Index;FEN;Mate in;Time [ms];PV;Utilization [%]" << std::endl;
 
           while (!is.eof())
           {
@@ -248,6 +250,7 @@ namespace {
               pos.set(fen, false, &sp->back(), Threads.main());
               TT.clear();
               Threads.clear();
+              Threads.wait_for_idle(); // Don't count the hash clearing
               TimePoint time = now();
               Threads.start_thinking(pos, sp, limits);
               Threads.main()->wait_for_search_finished();
@@ -256,18 +259,290 @@ namespace {
               Thread* bestThread = Threads.get_best_thread();
               TimePoint elapsed_time = now() - time;
               std::string san = SAN::to_san(pos, bestThread->rootMoves[0]);
-              csv << elapsed_time << ";" << san << std::endl;
-              std::cout << std::endl;
+              csv << elapsed_time << ";" << san << ";";
+
+              // Show how busy each thread was, and how many root moves
+              // each helper took from the queue of the mate search
+              std::cout << "Thread utilization:";
+              for (Thread* th : Threads)
+              {
+                  int busy = int(100 * th->busyTime / std::max(elapsed_time, TimePoint(1)));
+                  std::cout << " " << busy << "%";
+                  if (th->mateItems)
+                      std::cout << " (" << th->mateItems << " moves)";
+                  csv << (th != Threads.front() ? "/" : "") << busy;
+              }
+              csv << std::endl;
+              std::cout << std::endl << std::endl;
           }
       }
   }
 
-  void test(std::istringstream& is) {
+  // collect_tb() appends to fens the position and those reached from it within
+  // the given number of plies that can be probed in the tablebases.
+
+  void collect_tb(Position& pos, int plies, vector<string>& fens) {
+
+      if (   popcount(pos.pieces()) <= Tablebases::MaxCardinality
+          && !pos.can_castle(ANY_CASTLING))
+          fens.push_back(pos.fen());
+
+      if (plies > 0)
+          for (const auto& m : MoveList<LEGAL>(pos))
+          {
+              StateInfo st;
+              pos.do_move(m, st);
+              collect_tb(pos, plies - 1, fens);
+              pos.undo_move(m);
+          }
+  }
+
+  // test_tb() is a microbenchmark of the tablebase probes. It probes the bench
+  // positions, or those of the given file, and the positions reached from them
+  // in two plies, first once to load the table pages and then 'rounds' times,
+  // and reports the average time of a WDL and of a DTZ probe.
+
+  void test_tb(const Position& current, istringstream& is) {
+
+      string token;
+      int rounds = (is >> token) ? stoi(token) : 100;
+      string fenFile = (is >> token) ? token : "default";
+
+      if (!Tablebases::MaxCardinality)
+      {
+          sync_cout << "No tablebases found, set SyzygyPath first" << sync_endl;
+          return;
+      }
+
+      istringstream args("16 1 1 " + fenFile);
+      vector<string> fens;
+
+      for (const auto& cmd : setup_bench(current, args))
+          if (cmd.find("position fen ") == 0)
+          {
+              StateInfo st;
+              Position pos;
+              pos.set(cmd.substr(13), false, &st, Threads.main());
+              collect_tb(pos, 2, fens);
+          }
+
+      std::deque<StateInfo> states(fens.size());
+      std::deque<Position> positions(fens.size());
+
+      for (size_t i = 0; i < fens.size(); ++i)
+          positions[i].set(fens[i], false, &states[i], Threads.main());
+
+      uint64_t probes = 0, fails = 0;
+      Tablebases::ProbeState result;
+
+      auto run = [&](bool dtz, int n) {
+          probes = fails = 0;
+          TimePoint start = now();
+
+          for (int r = 0; r < n; ++r)
+              for (auto& pos : positions)
+              {
+                  dtz ? (void)Tablebases::probe_dtz(pos, &result)
+                      : (void)Tablebases::probe_wdl(pos, &result);
+                  ++probes;
+                  fails += result == Tablebases::FAIL;
+              }
+
+          return now() - start + 1; // Ensure positivity to avoid a 'divide by zero'
+      };
+
+      run(false, 1);
+      run(true, 1);
+
+      for (bool dtz : { false, true })
+      {
+          TimePoint elapsed = run(dtz, rounds);
+
+          sync_cout << (dtz ? "DTZ" : "WDL")
+                    << " probes: " << probes << " (" << fails << " failed)"
+                    << ", total time (ms): " << elapsed
+                    << ", ns/probe: " << elapsed * 1000000 / std::max(probes, uint64_t(1)) << sync_endl;
+      }
+  }
+
+  // test_attacks() is a microbenchmark of the slider attack lookups on random
+  // occupancies. It reports the table layout of the build and the average time
+  // of a lookup, to compare builds with magics, pext and pdep.
+
+  void test_attacks(istringstream& is) {
+
+      string token;
+      uint64_t lookups = 1000000 * ((is >> token) ? stoull(token) : 100);
+
+      constexpr size_t Size = 4096;
+      Square sq[Size];
+      Bitboard occ[Size];
+      PRNG rng(1070372);
+
+      for (size_t i = 0; i < Size; ++i)
+      {
+          sq[i] = Square(rng.rand<unsigned>() % SQUARE_NB);
+          occ[i] = rng.rand<Bitboard>() & rng.rand<Bitboard>(); // About 16 pieces
+      }
+
+      sync_cout << "Slider attacks: " << (HasPdep ? "pext index, pdep compressed tables"
+                                        : HasPext ? "pext index" : "magics") << sync_endl;
+
+      for (PieceType pt : { BISHOP, ROOK })
+      {
+          Bitboard acc = 0;
+          TimePoint start = now();
+
+          for (uint64_t n = 0; n < lookups; ++n)
+              acc ^= attacks_bb(pt, sq[n % Size], occ[n % Size]);
+
+          TimePoint elapsed = now() - start + 1; // Ensure positivity to avoid a 'divide by zero'
+
+          sync_cout << (pt == ROOK ? "Rook" : "Bishop")
+                    << " lookups: " << lookups
+                    << ", total time (ms): " << elapsed
+                    << ", ns/lookup: " << double(elapsed) * 1000000 / lookups
+                    << " (" << popcount(acc) << ")" << sync_endl;
+      }
+  }
+
+  // test_movegen() is a microbenchmark of the move generation. It generates the
+  // moves of the bench positions, or those of the given file, and of the positions
+  // reached from them in one ply, as the MovePicker does (captures, then quiets,
+  // or evasions) and as perft does (legal moves), and reports the average time.
+
+  void test_movegen(const Position& current, istringstream& is) {
+
+      string token;
+      int rounds = (is >> token) ? stoi(token) : 1000;
+      string fenFile = (is >> token) ? token : "default";
+
+      istringstream args("16 1 1 " + fenFile);
+      vector<string> fens;
+
+      for (const auto& cmd : setup_bench(current, args))
+          if (cmd.find("position fen ") == 0)
+          {
+              StateInfo st, st2;
+              Position pos;
+              pos.set(cmd.substr(13), false, &st, Threads.main());
+              fens.push_back(pos.fen());
+
+              for (const auto& m : MoveList<LEGAL>(pos))
+              {
+                  pos.do_move(m, st2);
+                  fens.push_back(pos.fen());
+                  pos.undo_move(m);
+              }
+          }
+
+      std::deque<StateInfo> states(fens.size());
+      std::deque<Position> positions(fens.size());
+
+      for (size_t i = 0; i < fens.size(); ++i)
+          positions[i].set(fens[i], false, &states[i], Threads.main());
+
+      for (bool legal : { false, true })
+      {
+          ExtMove moves[MAX_MOVES];
+          uint64_t generated = 0;
+          TimePoint start = now();
+
+          for (int r = 0; r < rounds; ++r)
+              for (const auto& pos : positions)
+                  if (legal)
+                      generated += generate<LEGAL>(pos, moves) - moves;
+
+                  else if (pos.checkers())
+                      generated += generate<EVASIONS>(pos, moves) - moves;
+
+                  else
+                  {
+                      ExtMove* end = generate<CAPTURES>(pos, moves);
+                      generated += generate<QUIETS>(pos, end) - moves;
+                  }
+
+          TimePoint elapsed = now() - start + 1; // Ensure positivity to avoid a 'divide by zero'
+
+          sync_cout << (legal ? "Legal" : "MovePicker") << " generation: "
+                    << uint64_t(rounds) * positions.size() << " positions, "
+                    << generated << " moves, total time (ms): " << elapsed
+                    << ", ns/move: " << double(elapsed) * 1000000 / std::max(generated, uint64_t(1)) << sync_endl;
+      }
+  }
+
+  // test_legal() is a microbenchmark of Position::has_legal_move() against the
+  // generation of all the legal moves, on the same positions as test_movegen().
+  // It reports the average time of both tests per position.
+
+  void test_legal(const Position& current, istringstream& is) {
+
+      string token;
+      int rounds = (is >> token) ? stoi(token) : 1000;
+      string fenFile = (is >> token) ? token : "default";
+
+      istringstream args("16 1 1 " + fenFile);
+      vector<string> fens;
+
+      for (const auto& cmd : setup_bench(current, args))
+          if (cmd.find("position fen ") == 0)
+          {
+              StateInfo st, st2;
+              Position pos;
+              pos.set(cmd.substr(13), false, &st, Threads.main());
+              fens.push_back(pos.fen());
+
+              for (const auto& m : MoveList<LEGAL>(pos))
+              {
+                  pos.do_move(m, st2);
+                  fens.push_back(pos.fen());
+                  pos.undo_move(m);
+              }
+          }
+
+      std::deque<StateInfo> states(fens.size());
+      std::deque<Position> positions(fens.size());
+
+      for (size_t i = 0; i < fens.size(); ++i)
+          positions[i].set(fens[i], false, &states[i], Threads.main());
+
+      for (bool early : { false, true })
+      {
+          uint64_t withMoves = 0;
+          TimePoint start = now();
+
+          for (int r = 0; r < rounds; ++r)
+              for (const auto& pos : positions)
+                  withMoves += early ? pos.has_legal_move() : MoveList<LEGAL>(pos).size() > 0;
+
+          TimePoint elapsed = now() - start + 1; // Ensure positivity to avoid a 'divide by zero'
+          uint64_t tested = uint64_t(rounds) * positions.size();
+
+          sync_cout << (early ? "has_legal_move()" : "MoveList<LEGAL>") << ": "
+                    << tested << " positions, " << tested - withMoves << " without moves"
+                    << ", total time (ms): " << elapsed
+                    << ", ns/position: " << double(elapsed) * 1000000 / std::max(tested, uint64_t(1)) << sync_endl;
+      }
+  }
+
+  void test(const Position& pos, std::istringstream& is) {
 
       std::string token;
       is >> token;
       if (token == "mate")
           test_mate();
+
+      else if (token == "tb")
+          test_tb(pos, is);
+
+      else if (token == "attacks")
+          test_attacks(is);
+
+      else if (token == "movegen")
+          test_movegen(pos, is);
+
+      else if (token == "legal")
+          test_legal(pos, is);
   }
 
   // The win rate model returns the probability of winning (in per mille units) given an
@@ -352,6 +627,8 @@ void UCI::loop(int argc, char* argv[]) {
       else if (token == "flip")     pos.flip();
       else if (token == "bench")    bench(pos, is, states);
       else if (token == "d")        sync_cout << pos << sync_endl;
+      else if (token == "datagen")  DataGen::run(is);
+      else if (token == "analyze")  Analysis::run(pos, is, states);
       else if (token == "eval")     trace_eval(pos);
       else if (token == "compiler") sync_cout << compiler_info() << sync_endl;
       else if (token == "--help" || token == "help" || token == "--license" || token == "license")
@@ -363,7 +640,7 @@ void UCI::loop(int argc, char* argv[]) {
                        "\nor read the corresponding README.md and Copying.txt files distributed along with this program.\n" << sync_endl;
 
       else if (token == "test")
-          test(is);
+          test(pos, is);
 
       else if (!token.empty() && token[0] != '#')
           sync_cout << "Unknown command: '" << cmd << "'. Type help for more information." << sync_endl;
@@ -409,6 +686,15 @@ string UCI::wdl(Value v, int ply) {
 }
 
 
+// UCI::expected_score() returns the expected score of the side to move, in per
+// mille units, given an evaluation and a game ply, from the same WDL model.
+
+int UCI::expected_score(Value v, int ply) {
+
+  return (1000 + win_rate_model(v, ply) - win_rate_model(-v, ply)) / 2;
+}
+
+
 // UCI::square() converts a Square to a string in algebraic notation (g1, a7, etc.)
 
 std::string UCI::square(Square s) {
@@ -81,6 +81,7 @@ std::string square(Square s);
 std::string move(Move m, bool chess960);
 std::string pv(const Position& pos, Depth depth);
 std::string wdl(Value v, int ply);
+int expected_score(Value v, int ply);
 Move to_move(const Position& pos, std::string& str);
 std::string pv_to_string(const Position& pos, const Move* pv, bool isSAN);
 } // namespace UCI
@@ -18,10 +18,12 @@
 
 #include <algorithm>
 #include <cassert>
+#include <iostream>
 #include <ostream>
 #include <sstream>
 
 #include "evaluate.h"
+#include "metrics.h"
 #include "misc.h"
 #include "search.h"
 #include "thread.h"
@@ -39,10 +41,16 @@ namespace UCI {
 
 // 'On change' actions, triggered by an option's value change
 void on_clear_hash(const Option&) { Search::clear(); }
-void on_hash_size(const Option& o) { TT.resize(size_t(o)); }
+void on_hash_size(const Option& o) { TT.resize(size_t(o)); sync_cout << "info string " << TT.pages_info() << sync_endl; }
+void on_large_pages(const Option&) { Threads.set(size_t(Options["Threads"])); Threads.report_pages(); sync_cout << "info string " << TT.pages_info() << sync_endl; }
 void on_logger(const Option& o) { start_logger(o); }
-void on_threads(const Option& o) { Threads.set(size_t(o)); }
+void on_metrics_port(const Option& o) { Metrics::serve(int(o)); }
+void on_threads(const Option& o) { Threads.set(size_t(o)); Threads.report_pages(); }
+void on_numa_replicate(const Option&) { on_threads(Options["Threads"]); }
+void on_history_sharing(const Option&) { on_threads(Options["Threads"]); }
+void on_deterministic(const Option&) { if (int(Options["History Sharing"]) > 1) on_threads(Options["Threads"]); }
 void on_tb_path(const Option& o) { Tablebases::init(o); }
+void on_tb_preload(const Option&) { Tablebases::init(Options["SyzygyPath"]); }
 
 // Our case insensitive less() function as required by UCI protocol
 bool CaseInsensitiveLess::operator() (const string& s1, const string& s2) const {
@@ -60,8 +68,15 @@ void init(OptionsMap& o) {
 
   o["Debug Log File"]        << Option("", on_logger);
   o["Threads"]               << Option(1, 1, 1024, on_threads);
+  o["Deterministic"]         << Option(false, on_deterministic);
+  o["History Sharing"]       << Option(1, 1, 1024, on_history_sharing);
+#ifdef USE_NUMA
+  o["NUMA Replicate"]        << Option(false, on_numa_replicate);
+#endif
   o["Hash"]                  << Option(16, 1, MaxHashMB, on_hash_size);
   o["Clear Hash"]            << Option(on_clear_hash);
+  o["Large Pages"]           << Option("Auto var Auto var Off var 2MB var 1GB", "Auto", on_large_pages);
+  o["TT Replace"]            << Option("Auto var Auto var Depth var Mate", "Auto");
   o["Ponder"]                << Option(false);
   o["MultiPV"]               << Option(1, 1, MAX_MOVES);
   o["Skill Level"]           << Option(20, 0, 20);
@@ -77,6 +92,9 @@ void init(OptionsMap& o) {
   o["SyzygyProbeDepth"]      << Option(1, 1, 100);
   o["Syzygy50MoveRule"]      << Option(true);
   o["SyzygyProbeLimit"]      << Option(7, 0, 7);
+  o["SyzygyPreload"]         << Option("<empty>", on_tb_preload);
+  o["MetricsPort"]           << Option(0, 0, 65535, on_metrics_port);
+  o["SMPStats"]              << Option(false);
 }
 
 
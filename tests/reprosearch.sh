@@ -16,11 +16,14 @@ echo "reprosearch testing started"
 cat << EOF > repeat.exp
  set timeout 10
  spawn ./stockfish
- lassign \$argv nodes
+ lassign \$argv nodes threads deterministic
 
  send "uci\n"
  expect "uciok"
 
+ send "setoption name Threads value \$threads\n"
+ send "setoption name Deterministic value \$deterministic\n"
+
  send "ucinewgame\n"
  send "position startpos\n"
  send "go nodes \$nodes\n"
@@ -52,8 +55,24 @@ do
   echo "reprosearch testing with $nodes nodes"
 
   # each line should appear exactly an even number of times
-  expect repeat.exp $nodes 2>&1 | grep -o "nodes [0-9]*" | sort | uniq -c | awk '{if ($1%2!=0) exit(1)}'
+  expect repeat.exp $nodes 1 false 2>&1 | grep -o "nodes [0-9]*" | sort | uniq -c | awk '{if ($1%2!=0) exit(1)}'
+
+done
+
+# in deterministic mode the same holds for multithreaded searches. The node
+# counts of intermediate iterations depend on timing, but the final info line
+# before bestmove, and the bestmove itself, must be reproduced exactly.
+for threads in 2 4
+do
+for i in `seq 1 10`
+do
+
+  nodes=$((100*3**i/2**i))
+  echo "reprosearch testing with $nodes nodes, $threads threads, deterministic"
 
+  expect repeat.exp $nodes $threads true 2>&1 | grep -B1 "^bestmove" | grep -o "nodes [0-9]*\|^bestmove.*" | sort | uniq -c | awk '{if ($1%2!=0) exit(1)}'
+
+done
 done
 
 rm repeat.exp